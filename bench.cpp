@@ -0,0 +1,553 @@
+
+/**
+ * @file bench.cpp
+ * @brief Benchmarks for the Task Tracker storage and command paths.
+ *
+ * Generates tasks.json files of increasing size and measures, for each size:
+ * - load:         opening the file and reading every task (page cache dropped first)
+ * - save:         rewriting the whole file from memory (after a full load)
+ * - add, update, delete, mark-in-progress, mark-done: one CLI mutation each
+ * - list, list-status, list-updated-since: listing into a discarding stream
+ *
+ * Every (size, operation) pair runs in its own child process, so the reported
+ * peak RSS belongs to that operation alone (it includes the initial load).
+ * Results are printed as one JSON object per line on stdout, which makes runs
+ * from two builds easy to diff.
+ *
+ * Build and run:
+ *   g++ -std=c++17 -O2 -o bench bench.cpp
+ *   ./bench                                - sizes 1k, 10k, 100k, 1M
+ *   ./bench --sizes 1000,10000000          - custom sizes (10M needs several GB)
+ *   ./bench --ops load,mark-done --iters 5 - subset of operations, fixed iterations
+ *   ./bench --dir /tmp/bench               - where the generated files go
+ *   ./bench --backends                     - storage engine conformance run (1k, 10k)
+ *
+ * --backends drives every StorageEngine through the same workload (insert,
+ * reopen and scan, point gets, updates, removes, a predicate scan and a
+ * final reopen; for records also a remove/re-add churn that must not grow
+ * the description heap; for btree a churn that must reuse emptied leaves and
+ * a process killed before its commit) and checks each step against an
+ * in-memory model, so the engines are compared on identical work. A last
+ * step archives done subtasks and checks that list --tree still shows
+ * their parent's progress. Each engine and size runs in its own child; any
+ * mismatch is reported with "ok":false and fails the run.
+ *
+ * @author kumar
+ * @date 2024
+ */
+
+#define TATRA_NO_MAIN
+#include "tatra.cpp"
+
+#include <chrono>
+#include <random>
+#include <map>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Swallows everything written to it, so list benchmarks still pay for formatting
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+struct BenchResult {
+    string op;
+    size_t tasks;
+    vector<double> samples; // microseconds
+};
+
+// Write a tasks.json with n tasks in the format saveTasks produces
+void generateTasks(const string& path, size_t n, unsigned seed) {
+    mt19937_64 rng(seed);
+    const char* statuses[] = { "todo", "in-progress", "done" };
+    time_t now = time(0);
+
+    ofstream file(path);
+    file << "[\n";
+    for (size_t i = 0; i < n; i++) {
+        char created[32], updated[32];
+        time_t c = now - (time_t)(rng() % (365 * 86400));
+        time_t u = c + (time_t)(rng() % (30 * 86400));
+        ctime_r(&c, created);
+        ctime_r(&u, updated);
+        created[strlen(created) - 1] = '\0';
+        updated[strlen(updated) - 1] = '\0';
+
+        TaskTracker task((int)i + 1, "Benchmark task " + to_string(i + 1) + string(rng() % 64, 'x'),
+                         statuses[rng() % 3], created, updated);
+        if (i > 0) file << ",\n";
+        file << task.toJson();
+    }
+    file << "\n]";
+}
+
+// Ask the kernel to drop cached pages of the file so the next read is cold
+void dropPageCache(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+void copyFile(const string& from, const string& to) {
+    ifstream in(from, ios::binary);
+    ofstream out(to, ios::binary);
+    out << in.rdbuf();
+}
+
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+long peakRssKb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+void printResult(const BenchResult& r) {
+    vector<double> s = r.samples;
+    sort(s.begin(), s.end());
+    double total = 0;
+    for (double v : s) total += v;
+    double mean = s.empty() ? 0 : total / s.size();
+
+    printf("{\"op\":\"%s\",\"tasks\":%zu,\"iters\":%zu,\"mean_us\":%.1f,"
+           "\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f,"
+           "\"ops_per_sec\":%.2f,\"tasks_per_sec\":%.0f,\"peak_rss_kb\":%ld}\n",
+           r.op.c_str(), r.tasks, s.size(), mean,
+           percentile(s, 0.50), percentile(s, 0.90), percentile(s, 0.99),
+           s.empty() ? 0.0 : s.back(),
+           mean > 0 ? 1e6 / mean : 0.0,
+           mean > 0 ? r.tasks * 1e6 / mean : 0.0,
+           peakRssKb());
+    fflush(stdout);
+}
+
+template <typename F>
+double timeUs(F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(end - start).count();
+}
+
+// Run one operation against a private copy of the dataset; called in a child
+BenchResult runOp(const string& op, const string& dataset, const string& work,
+                  size_t n, size_t iters, unsigned seed) {
+    BenchResult r{op, n, {}};
+    mt19937_64 rng(seed);
+    auto randomId = [&]() { return (int)(rng() % n) + 1; };
+
+    copyFile(dataset, work);
+
+    if (op == "load") {
+        for (size_t i = 0; i < iters; i++) {
+            dropPageCache(work);
+            r.samples.push_back(timeUs([&]() { TaskManager(work).load(); }));
+        }
+        return r;
+    }
+
+    TaskManager manager(work);
+    if (op == "save") manager.load();
+    time_t dayAgo = time(0) - 86400;
+
+    // Ids are consumed in a random order so deletes never hit the same task
+    vector<int> ids(n);
+    for (size_t i = 0; i < n; i++) ids[i] = (int)i + 1;
+    shuffle(ids.begin(), ids.end(), rng);
+
+    map<string, function<void(size_t)>> ops = {
+        { "save",               [&](size_t) { manager.save(); } },
+        { "add",                [&](size_t) { manager.addTask("Benchmark added task"); } },
+        { "update",             [&](size_t) { manager.updateTask(randomId(), "Benchmark update"); } },
+        { "delete",             [&](size_t i) { manager.deleteTask(ids[i % n]); } },
+        { "mark-in-progress",   [&](size_t) { manager.markInProgress(randomId()); } },
+        { "mark-done",          [&](size_t) { manager.markDone(randomId()); } },
+        { "list",               [&](size_t) { manager.listAllTasks(); } },
+        { "list-status",        [&](size_t) { manager.listTasksByStatus("todo"); } },
+        { "list-updated-since", [&](size_t) {
+            manager.listTasksByTime(true, dayAgo, numeric_limits<time_t>::max()); } },
+    };
+
+    auto it = ops.find(op);
+    if (it == ops.end()) {
+        fprintf(stderr, "Unknown operation: %s\n", op.c_str());
+        exit(2);
+    }
+    for (size_t i = 0; i < iters; i++) {
+        r.samples.push_back(timeUs([&]() { it->second(i); }));
+    }
+    return r;
+}
+
+// Order-independent digest of a set of tasks, to compare scans with the model
+struct Digest {
+    size_t count = 0;
+    uint64_t sum = 0;
+
+    void add(const TaskTracker& task) {
+        count++;
+        sum += hash<string>()(task.toCompactJson());
+    }
+
+    bool operator==(const Digest& other) const {
+        return count == other.count && sum == other.sum;
+    }
+};
+
+// Run the conformance workload against one engine kind; called in a child.
+// Prints one line per step and returns false if any step disagreed with the
+// model.
+bool runBackend(const string& kind, const string& dir, size_t n, unsigned seed) {
+    string file = dir + "/backend-" + kind + "-" + to_string(n) + ".json";
+    mt19937_64 rng(seed);
+    map<int, TaskTracker> model;
+    bool allOk = true;
+
+    auto report = [&](const char* op, size_t count, double us, bool ok) {
+        printf("{\"backend\":\"%s\",\"op\":\"%s\",\"tasks\":%zu,\"ops\":%zu,"
+               "\"total_us\":%.1f,\"us_per_op\":%.3f,\"ok\":%s}\n",
+               kind.c_str(), op, n, count, us, count ? us / count : 0.0, ok ? "true" : "false");
+        fflush(stdout);
+        allOk = allOk && ok;
+    };
+    auto modelDigest = [&](const TaskPredicate& pred) {
+        Digest digest;
+        for (const auto& entry : model) {
+            if (!pred || pred(entry.second)) digest.add(entry.second);
+        }
+        return digest;
+    };
+    auto scanDigest = [&](StorageEngine& store, const TaskPredicate& pred) {
+        Digest digest;
+        store.scan(pred, [&](const TaskTracker& task) { digest.add(task); });
+        return digest;
+    };
+    auto reopen = [&]() { return openStorage(kind, file, false, 1000); };
+
+    const char* statuses[] = { "todo", "in-progress", "done" };
+    unique_ptr<StorageEngine> store = openStorage(kind, file, true, 1000);
+    double us = timeUs([&]() {
+        for (size_t i = 0; i < n; i++) {
+            TaskTracker task((int)i + 1, "Backend task " + to_string(i + 1) + string(rng() % 64, 'x'),
+                             statuses[rng() % 3], "Wed Jun  5 12:00:00 2024", "Wed Jun  5 12:00:00 2024");
+            store->upsert(task);
+            model.emplace(task.getId(), task);
+        }
+        store->commit();
+    });
+    report("insert", n, us, store->nextId() == (int)n + 1);
+
+    Digest scanned;
+    us = timeUs([&]() {
+        store = reopen();
+        scanned = scanDigest(*store, nullptr);
+    });
+    report("reopen-scan", n, us, scanned == modelDigest(nullptr));
+
+    size_t gets = min<size_t>(n, 10000);
+    bool ok = true;
+    us = timeUs([&]() {
+        for (size_t i = 0; i < gets; i++) {
+            int id = (int)(rng() % (n + 10)) + 1;
+            TaskTracker task(id);
+            auto it = model.find(id);
+            bool found = store->get(id, task);
+            if (found != (it != model.end()) ||
+                (found && task.toCompactJson() != it->second.toCompactJson())) ok = false;
+        }
+    });
+    report("get", gets, us, ok);
+
+    size_t changes = max<size_t>(1, n / 10);
+    vector<int> updated;
+    us = timeUs([&]() {
+        for (size_t i = 0; i < changes; i++) {
+            auto it = model.find((int)(rng() % n) + 1);
+            it->second.updateDescription("Updated " + to_string(i), "Thu Jun  6 08:30:00 2024");
+            store->upsert(it->second);
+            updated.push_back(it->first);
+        }
+        store->commit();
+    });
+    // Read a sample of the updated tasks back, outside the timing
+    ok = true;
+    for (size_t i = 0; i < updated.size(); i += max<size_t>(1, updated.size() / 1000)) {
+        TaskTracker task(updated[i]);
+        if (!store->get(updated[i], task) || task.toCompactJson() != model.at(updated[i]).toCompactJson()) ok = false;
+    }
+    report("update", changes, us, ok);
+
+    // Records only: tasks removed and added back short take the freed long
+    // blocks, so growing them again must fit without extending the heap
+    if (kind == "records") {
+        string heapFile = file.substr(0, file.size() - 5) + ".heap";
+        auto heapEnd = [&]() {
+            HeapHeader heapHeader;
+            memset(&heapHeader, 0, sizeof(heapHeader));
+            int fd = open(heapFile.c_str(), O_RDONLY);
+            if (fd >= 0) {
+                if (pread(fd, &heapHeader, sizeof(heapHeader), 0) != (ssize_t)sizeof(heapHeader)) heapHeader.end = 0;
+                close(fd);
+            }
+            return heapHeader.end;
+        };
+        size_t churned = min<size_t>(n, 1000);
+        uint64_t firstEnd = 0;
+        us = timeUs([&]() {
+            for (int round = 0; round < 5; round++) {
+                for (size_t id = 1; id <= churned; id++) store->remove((int)id);
+                store->commit();
+                for (size_t id = 1; id <= churned; id++) {
+                    TaskTracker task((int)id, "Short " + to_string(id), "todo",
+                                     "Wed Jun  5 12:00:00 2024", "Wed Jun  5 12:00:00 2024");
+                    store->upsert(task);
+                    task.updateDescription("Long " + string(1000, 'x'), "Thu Jun  6 08:30:00 2024");
+                    store->upsert(task);
+                    model.erase(task.getId());
+                    model.emplace(task.getId(), task);
+                }
+                store->commit();
+                if (round == 0) firstEnd = heapEnd();
+            }
+        });
+        report("heap-reuse", churned * 5, us, firstEnd != 0 && heapEnd() == firstEnd);
+    }
+
+    // B+tree only: removing the oldest tasks empties whole leaves, whose
+    // pages must be reused by the tasks added after them
+    if (kind == "btree") {
+        string treeFile = file.substr(0, file.size() - 5) + ".btree";
+        auto pageCount = [&]() {
+            BTreeHeader treeHeader;
+            memset(&treeHeader, 0, sizeof(treeHeader));
+            int fd = open(treeFile.c_str(), O_RDONLY);
+            if (fd >= 0) {
+                if (pread(fd, &treeHeader, sizeof(treeHeader), 0) != (ssize_t)sizeof(treeHeader)) treeHeader.pageCount = 0;
+                close(fd);
+            }
+            return treeHeader.pageCount;
+        };
+        size_t churned = min<size_t>(n, 1000);
+        uint32_t firstCount = 0;
+        us = timeUs([&]() {
+            for (int round = 0; round < 5; round++) {
+                for (size_t i = 0; i < churned && !model.empty(); i++) {
+                    store->remove(model.begin()->first);
+                    model.erase(model.begin());
+                }
+                for (size_t i = 0; i < churned; i++) {
+                    TaskTracker task(store->nextId(), "Churned task", "todo",
+                                     "Wed Jun  5 12:00:00 2024", "Wed Jun  5 12:00:00 2024");
+                    store->upsert(task);
+                    model.emplace(task.getId(), task);
+                }
+                store->commit();
+                if (round == 0) firstCount = pageCount();
+            }
+        });
+        report("leaf-reuse", churned * 5, us, firstCount != 0 && pageCount() == firstCount &&
+               scanDigest(*store, nullptr) == modelDigest(nullptr));
+
+        // Enough uncommitted changes to overflow the buffer pool, then the
+        // process dies: the reopened tree must be the committed one
+        us = timeUs([&]() {
+            pid_t pid = fork();
+            if (pid == 0) {
+                for (int i = 0; i < 6000; i++) {
+                    TaskTracker task(store->nextId(), "Lost " + string(900, 'x'), "todo",
+                                     "Wed Jun  5 12:00:00 2024", "Wed Jun  5 12:00:00 2024");
+                    store->upsert(task);
+                }
+                for (const auto& entry : model) {
+                    if (entry.first % 2 == 0) store->remove(entry.first);
+                }
+                _exit(0);
+            }
+            int status;
+            waitpid(pid, &status, 0);
+            store = reopen();
+            scanned = scanDigest(*store, nullptr);
+        });
+        report("crash-before-commit", model.size(), us, scanned == modelDigest(nullptr));
+    }
+
+    ok = true;
+    us = timeUs([&]() {
+        for (size_t i = 0; i < changes; i++) {
+            int id = (int)(rng() % n) + 1;
+            bool expected = model.erase(id) > 0;
+            if (store->remove(id) != expected) ok = false;
+        }
+        store->commit();
+    });
+    report("remove", changes, us, ok);
+
+    TaskPredicate isDone = [](const TaskTracker& task) { return task.status == "done"; };
+    us = timeUs([&]() { scanned = scanDigest(*store, isDone); });
+    report("scan-predicate", n, us, scanned == modelDigest(isDone));
+
+    // Everything must have survived the commits
+    us = timeUs([&]() {
+        store = reopen();
+        scanned = scanDigest(*store, nullptr);
+    });
+    report("reopen-verify", model.size(), us, scanned == modelDigest(nullptr));
+
+    store->destroy();
+    unlink((file + ".bak").c_str());
+
+    // Archiving done subtasks keeps their share in the parent: list --tree
+    // shows the same progress for it before and after the run
+    string treeFile = dir + "/tree-" + kind + "-" + to_string(n) + ".json";
+    setenv("TASK_STORAGE", kind.c_str(), 1);
+    string before, after;
+    auto treeRoot = [&]() {
+        ostringstream out;
+        streambuf* saved = cout.rdbuf(out.rdbuf());
+        TaskManager(treeFile).listTaskTree(1);
+        cout.rdbuf(saved);
+        return out.str().substr(0, out.str().find('\n'));
+    };
+    us = timeUs([&]() {
+        TaskManager tree(treeFile);
+        tree.addTask("Parent");
+        for (int i = 0; i < 4; i++) tree.addTask("Subtask", 0, {}, 1);
+        for (int id = 2; id <= 4; id++) tree.markDone(id);
+        before = treeRoot();
+        tree.archiveTasks(0);
+        after = treeRoot();
+    });
+    report("tree-archive", 5, us, before.find("Progress: 3/4") != string::npos && after == before);
+
+    openStorage(kind, treeFile, false, 1000)->destroy();
+    unlink((treeFile + ".bak").c_str());
+    ArchiveStore archive;
+    archive.dir = baseName(treeFile) + ".archive";
+    archive.loadManifest();
+    for (const auto& segment : archive.segments) unlink((archive.dir + "/" + segment.name).c_str());
+    unlink((archive.dir + "/manifest").c_str());
+    rmdir(archive.dir.c_str());
+    return allOk;
+}
+
+vector<string> splitList(const string& s) {
+    vector<string> out;
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    vector<size_t> sizes = { 1000, 10000, 100000, 1000000 };
+    bool sizesGiven = false;
+    vector<string> opNames = { "load", "save", "add", "update", "delete",
+                               "mark-in-progress", "mark-done",
+                               "list", "list-status", "list-updated-since" };
+    size_t fixedIters = 0;
+    string dir = "bench-data";
+    unsigned seed = 42;
+    bool backends = false;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--backends") {
+            backends = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--sizes") {
+            sizesGiven = true;
+            sizes.clear();
+            for (const string& v : splitList(value)) sizes.push_back(stoull(v));
+        }
+        else if (arg == "--ops") opNames = splitList(value);
+        else if (arg == "--iters") fixedIters = stoull(value);
+        else if (arg == "--dir") dir = value;
+        else if (arg == "--seed") seed = (unsigned)stoul(value);
+        else {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    mkdir(dir.c_str(), 0755);
+
+    // Automatic archival would move done tasks out of the measured file
+    setenv("TASK_ARCHIVE_DAYS", "0", 0);
+
+    // Results go to stdout; the task manager's own messages are discarded.
+    // The buffer is never freed because cout may still flush it at exit.
+    cout.rdbuf(new NullBuffer);
+
+    printf("{\"bench\":\"task-tracker\",\"compiler\":\"%s\",\"seed\":%u}\n", __VERSION__, seed);
+    fflush(stdout);
+
+    if (backends) {
+        // Conformance, not timing: small sizes keep a full run to seconds
+        if (!sizesGiven) sizes = { 1000, 10000 };
+        bool failed = false;
+        for (size_t n : sizes) {
+            for (const char* kind : STORAGE_KINDS) {
+                pid_t pid = fork();
+                if (pid == 0) {
+                    _exit(runBackend(kind, dir, n, seed) ? 0 : 3);
+                }
+                int status = 0;
+                waitpid(pid, &status, 0);
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    fprintf(stderr, "Backend %s at %zu tasks failed\n", kind, n);
+                    failed = true;
+                }
+            }
+        }
+        return failed ? 1 : 0;
+    }
+
+    for (size_t n : sizes) {
+        string dataset = dir + "/tasks-" + to_string(n) + ".json";
+        string work = dir + "/work-" + to_string(n) + ".json";
+
+        struct stat st;
+        if (stat(dataset.c_str(), &st) != 0) {
+            generateTasks(dataset, n, seed);
+        }
+
+        // Whole-file operations get fewer iterations as the file grows
+        size_t iters = fixedIters ? fixedIters : max<size_t>(3, min<size_t>(100, 2000000 / n));
+
+        for (const string& op : opNames) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                printResult(runOp(op, dataset, work, n, iters, seed));
+                _exit(0);
+            }
+            int status = 0;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "Benchmark %s at %zu tasks failed\n", op.c_str(), n);
+                return 1;
+            }
+        }
+        unlink(work.c_str());
+    }
+    return 0;
+}
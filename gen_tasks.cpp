@@ -0,0 +1,227 @@
+
+/**
+ * @file gen_tasks.cpp
+ * @brief Deterministic generator of large synthetic tasks.json files.
+ *
+ * Writes tasks through TaskTracker::toJson, so the output is byte-for-byte the
+ * format saveTasks produces, and streams it through a fixed buffer so memory
+ * use does not depend on the number of tasks.
+ *
+ * The data is shaped like a long-lived tracker:
+ * - a skewed status mix (mostly done, some todo, few in-progress)
+ * - mostly short descriptions with a long tail of long ones
+ * - createdAt rising with the id across the time span, updatedAt after it
+ * - gaps in the ids, as left behind by deleted tasks
+ *
+ * The same seed and options always produce the same file. Random numbers come
+ * from a local splitmix64 rather than <random> distributions, whose output
+ * differs between standard libraries. Timestamps are formatted in the local
+ * time zone like the tracker itself, so run with a fixed TZ (e.g. TZ=UTC) to
+ * get identical files on different machines.
+ *
+ * Build and run:
+ *   g++ -std=c++17 -O2 -o gen_tasks gen_tasks.cpp
+ *   ./gen_tasks --count 1000000                      - writes tasks.json
+ *   ./gen_tasks --count 100000000 --out big.json     - 100M tasks
+ *   ./gen_tasks --count 1000 --seed 7 --out -        - to stdout
+ *
+ * Options:
+ *   --count N          number of tasks (default 1000)
+ *   --seed S           random seed (default 1)
+ *   --out PATH         output file, "-" for stdout (default tasks.json)
+ *   --mix D,T,P        percent done, todo, in-progress (default 70,20,10)
+ *   --delete-rate R    fraction of ids left unused (default 0.05)
+ *   --span-days N      days between the first and last createdAt (default 730)
+ *   --end EPOCH        createdAt of the last task (default 2024-06-01 00:00 UTC)
+ *
+ * @author kumar
+ * @date 2024
+ */
+
+#define TATRA_NO_MAIN
+#include "tatra.cpp"
+
+#include <cstdio>
+#include <cstdint>
+
+// splitmix64: tiny, fast and identical on every platform
+class SplitMix64 {
+private:
+    uint64_t state;
+
+public:
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, n)
+    uint64_t below(uint64_t n) {
+        return (uint64_t)(((unsigned __int128)next() * n) >> 64);
+    }
+
+    // Uniform in [0, 1)
+    double unit() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// Formats ctime strings, calling localtime_r only once per hour of input
+class TimeFormatter {
+private:
+    time_t hourStart = -1;
+    struct tm hourTm;
+
+public:
+    // Writes "Www Mmm dd hh:mm:ss yyyy" (24 chars) into out
+    void format(time_t t, char* out) {
+        time_t hour = t - ((t % 3600) + 3600) % 3600;
+        if (hour != hourStart) {
+            localtime_r(&hour, &hourTm);
+            hourStart = hour;
+        }
+        struct tm tm = hourTm;
+        int offset = (int)(t - hour);
+        tm.tm_min += offset / 60;
+        tm.tm_sec += offset % 60;
+        if (tm.tm_sec >= 60) { tm.tm_sec -= 60; tm.tm_min++; }
+        if (tm.tm_min >= 60) {
+            // Hour starts are not aligned with local hours in this zone
+            localtime_r(&t, &tm);
+        }
+        strftime(out, 32, "%a %b %e %H:%M:%S %Y", &tm);
+    }
+};
+
+const char* WORDS[] = {
+    "fix", "add", "update", "remove", "refactor", "deploy", "review", "write",
+    "test", "docs", "for", "the", "login", "page", "api", "cache", "database",
+    "migration", "build", "pipeline", "release", "notes", "bug", "in", "parser",
+    "config", "service", "client", "timeout", "retry", "logging", "metrics",
+    "dashboard", "alert", "on-call", "backup", "restore", "index", "query",
+    "schema", "endpoint", "auth", "token", "rotate", "keys", "upgrade",
+    "dependency", "cleanup", "flaky", "integration", "staging", "production",
+    "rollback", "hotfix", "customer", "report", "investigate", "latency",
+    "memory", "leak", "disk", "quota", "team", "sync", "planning", "sprint"
+};
+const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// Mostly 2-8 words, 1 in 20 up to 60, 1 in 500 up to 400
+string makeDescription(SplitMix64& rng) {
+    uint64_t r = rng.below(1000);
+    size_t words;
+    if (r < 2) words = 60 + rng.below(340);
+    else if (r < 50) words = 9 + rng.below(52);
+    else words = 2 + rng.below(7);
+
+    string desc;
+    desc.reserve(words * 8);
+    for (size_t i = 0; i < words; i++) {
+        if (i > 0) desc += ' ';
+        desc += WORDS[rng.below(WORD_COUNT)];
+    }
+    desc[0] = (char)toupper(desc[0]);
+    return desc;
+}
+
+void usage() {
+    fprintf(stderr, "Usage: gen_tasks [--count N] [--seed S] [--out PATH|-] [--mix D,T,P]\n"
+                    "                 [--delete-rate R] [--span-days N] [--end EPOCH]\n");
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t count = 1000;
+    uint64_t seed = 1;
+    string out = "tasks.json";
+    int mixDone = 70, mixTodo = 20, mixProgress = 10;
+    double deleteRate = 0.05;
+    long spanDays = 730;
+    time_t end = 1717200000; // 2024-06-01 00:00:00 UTC
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--count") count = stoull(value);
+        else if (arg == "--seed") seed = stoull(value);
+        else if (arg == "--out") out = value;
+        else if (arg == "--delete-rate") deleteRate = stod(value);
+        else if (arg == "--span-days") spanDays = stol(value);
+        else if (arg == "--end") end = (time_t)stoll(value);
+        else if (arg == "--mix") {
+            if (sscanf(value.c_str(), "%d,%d,%d", &mixDone, &mixTodo, &mixProgress) != 3 ||
+                mixDone < 0 || mixTodo < 0 || mixProgress < 0 ||
+                mixDone + mixTodo + mixProgress == 0) {
+                fprintf(stderr, "Invalid --mix, expected three percentages like 70,20,10\n");
+                return 1;
+            }
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (deleteRate < 0 || deleteRate >= 1 || spanDays < 0) {
+        usage();
+        return 1;
+    }
+
+    FILE* file = out == "-" ? stdout : fopen(out.c_str(), "wb");
+    if (file == nullptr) {
+        perror(out.c_str());
+        return 1;
+    }
+    static char buffer[1 << 20];
+    setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+    SplitMix64 rng(seed);
+    TimeFormatter formatter;
+    int mixTotal = mixDone + mixTodo + mixProgress;
+    time_t span = (time_t)spanDays * 86400;
+    time_t start = end - span;
+    char created[32], updated[32];
+
+    fputs("[\n", file);
+    int id = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        // Skip ids the way deletes would have left them
+        id++;
+        while (rng.unit() < deleteRate) id++;
+
+        // createdAt grows with the id, with a little jitter
+        time_t c = start + (time_t)(count > 1 ? (double)span * i / (count - 1) : span);
+        c -= (time_t)rng.below(600);
+
+        int pick = (int)rng.below(mixTotal);
+        const char* status = pick < mixDone ? "done"
+                           : pick < mixDone + mixTodo ? "todo" : "in-progress";
+
+        // Untouched todos keep updatedAt == createdAt; others moved later
+        time_t u = c;
+        if (status[0] != 't' || rng.below(4) == 0) {
+            time_t room = end - c;
+            u = c + (time_t)(room > 0 ? rng.below((uint64_t)min<time_t>(room, 90 * 86400)) : 0);
+        }
+        formatter.format(c, created);
+        formatter.format(u, updated);
+
+        TaskTracker task(id, makeDescription(rng), status, created, updated);
+        if (i > 0) fputs(",\n", file);
+        const string json = task.toJson();
+        fwrite(json.data(), 1, json.size(), file);
+    }
+    fputs("\n]", file);
+
+    if (fflush(file) != 0 || (file != stdout && fclose(file) != 0)) {
+        perror(out.c_str());
+        return 1;
+    }
+    return 0;
+}
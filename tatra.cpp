@@ -18,15 +18,105 @@
  * - TaskManager: Manages a collection of TaskTracker objects, handles file I/O, and provides task operations.
  *
  * Usage:
- *   task-cli add "description"        - Add a new task
+ *   task-cli add "description" [--priority n] [--tag tag]... [--parent id] - Add a new task
  *   task-cli update <id> "description" - Update task description
  *   task-cli delete <id>               - Delete a task
  *   task-cli mark-in-progress <id>     - Mark task as in progress
  *   task-cli mark-done <id>            - Mark task as done
+ *   task-cli claim [--worker name] [--lease seconds] - Take the oldest todo task
+ *   task-cli heartbeat <id> [seconds] [--worker name] - Renew a claim's lease
+ *   task-cli priority <id> <n>         - Set a task's priority
+ *   task-cli tag|untag <id> <tag>...   - Add or remove labels
+ *   task-cli depend <id> on <id>       - Make a task wait for another
+ *   task-cli next [--status status]    - Show the top-priority todo (or status) task
  *   task-cli list                      - List all tasks
  *   task-cli list done                 - List completed tasks
  *   task-cli list todo                 - List todo tasks
  *   task-cli list in-progress          - List in-progress tasks
+ *   task-cli list --updated-since <t>  - List tasks updated since a time
+ *   task-cli list --created-between <from> <to> - List tasks created in a range
+ *   task-cli list --all [status]       - Include archived tasks
+ *   task-cli list --tag <tag>... [--status s] - List tasks with all the tags
+ *   task-cli list --tree [id]          - List tasks as a tree of subtasks with progress
+ *   task-cli list --ready              - List todo tasks whose dependencies are done
+ *   task-cli count [status]            - Count tasks per status
+ *   task-cli count --tag <tag>... [--status s] - Count tasks with all the tags
+ *   task-cli search "text"             - Search descriptions, archive included
+ *   task-cli query [--all] '<expr>'    - List tasks matching a query (see TaskQuery)
+ *   task-cli archive [days]            - Archive done tasks older than days
+ *   task-cli export [status]           - Write tasks to stdout as NDJSON
+ *   task-cli serve [window-us] [batch] - Run as a server on tasks.sock
+ *   task-cli storage [kind] [size]     - Show or change the storage engine
+ *   task-cli format json|ndjson|records - Same as storage json|ndjson|records
+ *   task-cli shard [size]              - Same as storage sharded [size]
+ *   task-cli unshard                   - Same as storage json
+ *
+ * Tasks are kept by a storage engine behind the StorageEngine interface. The
+ * engine is chosen per tracker: TASK_STORAGE, else "storage = <kind>" in
+ * tasks.conf (written by "storage <kind>"), else the layout found on disk.
+ * The engines are json/ndjson, sharded, records and btree, described below.
+ *
+ * tasks.json is either a pretty-printed JSON array or NDJSON (one task per
+ * line), detected when it is read. In NDJSON mode "add" appends a single line
+ * and large files are parsed on several threads. TASK_FORMAT=ndjson selects
+ * NDJSON for new files and converts existing ones on their next save.
+ *
+ * "format records" moves tasks into tasks.rec, memory-mapped fixed-width
+ * records sorted by id, with descriptions in tasks.heap. Point operations
+ * binary-search the mapped file and rewrite only the changed fields in place.
+ *
+ * "storage btree" keeps tasks in tasks.btree, a B+tree of 4 KiB pages keyed
+ * by id and read through a fixed 4 MiB buffer pool, so point operations cost
+ * O(log N) page reads and memory stays bounded however many tasks there are.
+ * Commits go through a redo log (tasks.btree.wal), so a crash leaves the
+ * tree as of the last commit.
+ *
+ * After "shard", tasks live in tasks.d/: a manifest plus one file per id range.
+ * Point operations then load and rewrite a single shard; list reads all
+ * shards in parallel.
+ *
+ * Listing a status or counting streams tasks.json in 1 MiB blocks, as do
+ * list, search and export when the file is too large to load (over a
+ * quarter of free memory, or TASK_STREAM_BYTES), so memory use stays
+ * constant however large the file grows.
+ *
+ * Parsed tasks are cached in tasks.json.cache; while tasks.json is unchanged
+ * (same inode, size, mtime and content hash) it is loaded from there instead
+ * of being parsed. The cache is written only by commands that parsed the
+ * file and changed nothing. TASK_CACHE=0 disables the cache.
+ *
+ * Done tasks not updated for 30 days (TASK_ARCHIVE_DAYS, 0 disables) are moved
+ * once a day into write-once monthly segments in tasks.archive/, keeping the
+ * hot tasks.json small. "list --all" and "search" read the archive as well.
+ * The archive is synced before the hot file is saved; if a crash comes in
+ * between, the next changing command drops the tasks left in the hot file.
+ *
+ * "claim" makes the tracker a work queue: it marks the oldest todo task in
+ * progress, records the worker given with --worker as an optional field
+ * (shown as "| Worker: name"), and prints the task. Without a server every
+ * changing command holds an flock on tasks.lock, so concurrent claims never
+ * hand out the same task; with one, claims are applied in order anyway.
+ * A claim holds a lease (--lease, else lease-seconds in tasks.conf, else
+ * 300 s) that "heartbeat <id>" renews; given --worker, only for the worker
+ * holding the claim. Lapsed leases put the task back to todo: every second
+ * while a server runs, else when a claim passes the task on its way to the
+ * oldest todo task.
+ *
+ * While "task-cli serve" runs, every other invocation in the directory
+ * forwards its command line over tasks.sock to the resident server, which
+ * group-commits mutations: one write and one fsync per batch of clients
+ * (default window 200 us, batch 128). Plain list, count and search read a
+ * snapshot published after each batch and never wait for writes; once the
+ * server has copied it to shared memory, clients read it there directly.
+ * TASK_DAEMON=0 bypasses the server.
+ *
+ * Add --timings anywhere on the command line (or set TASK_TIMINGS=1) to get a
+ * per-phase timing report on stderr. --stats (or TASK_STATS=1) adds heap
+ * allocation counts and read/write syscall counts per phase to that report.
+ *
+ * Time arguments accept a relative age ("30m", "1h", "7d", "2w"), a date
+ * ("2024-05-01" or "2024-05-01 13:30"), "@<epoch seconds>", or the ctime
+ * format used in tasks.json.
  *
  * @author kumar
  * @date 2024
@@ -36,11 +126,130 @@
 #include <fstream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <ctime>
 #include <algorithm>
+#include <set>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <limits>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <thread>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#include <unordered_set>
 using namespace std;
 
+// Parse a timestamp as written by ctime(), e.g. "Wed Jun 12 14:03:27 2024".
+// Returns -1 if the string is not in that format.
+time_t parseTimestamp(const string& s) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(s.c_str(), "%a %b %d %H:%M:%S %Y", &tm);
+    if (end == nullptr || *end != '\0') return -1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// A ctime() timestamp as the number yyyymmddhhmmss, read straight from its
+// fixed layout; -1 if it is not in that format. Keys order like the local
+// times they stand for (bar the repeated hour when clocks go back), so
+// range checks compare integers instead of calling strptime and mktime on
+// every task.
+int64_t clockKey(string_view s) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if (s.size() != 24) return -1;
+    int month = 0;
+    while (month < 12 && memcmp(months + month * 3, s.data() + 4, 3) != 0) month++;
+    if (month == 12) return -1;
+    auto digits = [&](size_t at, size_t count) {
+        int64_t value = 0;
+        for (size_t i = at; i < at + count; i++) {
+            if (s[i] != ' ') value = value * 10 + (s[i] - '0');
+        }
+        return value;
+    };
+    return ((((digits(20, 4) * 100 + month + 1) * 100 + digits(8, 2)) * 100 +
+             digits(11, 2)) * 100 + digits(14, 2)) * 100 + digits(17, 2);
+}
+
+// The key of a point in time, as its ctime() text would give
+int64_t clockKey(time_t t) {
+    struct tm tm;
+    if (localtime_r(&t, &tm) == nullptr) return t < 0 ? -1 : numeric_limits<int64_t>::max();
+    return (((((tm.tm_year + 1900LL) * 100 + tm.tm_mon + 1) * 100 + tm.tm_mday) * 100 +
+             tm.tm_hour) * 100 + tm.tm_min) * 100 + tm.tm_sec;
+}
+
+// Parse a time given on the command line. Accepts a relative age counted
+// back from now ("90s", "30m", "1h", "7d", "2w"), "@<epoch seconds>",
+// "YYYY-MM-DD", "YYYY-MM-DD HH:MM[:SS]" (or with 'T'), or ctime format.
+bool parseTimeArg(const string& arg, time_t now, time_t& out) {
+    if (arg.empty()) return false;
+    
+    if (arg[0] == '@') {
+        char* end;
+        long long v = strtoll(arg.c_str() + 1, &end, 10);
+        if (end == arg.c_str() + 1 || *end != '\0') return false;
+        out = (time_t)v;
+        return true;
+    }
+    
+    char* end;
+    long long n = strtoll(arg.c_str(), &end, 10);
+    if (end != arg.c_str() && end[0] != '\0' && end[1] == '\0') {
+        long long unit = 0;
+        switch (end[0]) {
+            case 's': unit = 1; break;
+            case 'm': unit = 60; break;
+            case 'h': unit = 3600; break;
+            case 'd': unit = 86400; break;
+            case 'w': unit = 7 * 86400; break;
+        }
+        if (unit != 0) {
+            out = now - (time_t)(n * unit);
+            return true;
+        }
+    }
+    
+    const char* formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S",
+                              "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%Y-%m-%d" };
+    for (const char* fmt : formats) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char* rest = strptime(arg.c_str(), fmt, &tm);
+        if (rest != nullptr && *rest == '\0') {
+            tm.tm_isdst = -1;
+            out = mktime(&tm);
+            return true;
+        }
+    }
+    
+    time_t t = parseTimestamp(arg);
+    if (t == -1) return false;
+    out = t;
+    return true;
+}
+
 class TaskTracker {
 private:
     int id;
@@ -52,6 +261,11 @@ public:
     string createdAt;
     string updatedAt;
     
+    // Optional fields beyond the five above (such as "worker"), encoded as
+    // name NUL value NUL in the order they were first set. Tasks without any
+    // are stored exactly as before.
+    string extra;
+    
     TaskTracker(int i) : id(i) {}
     
     TaskTracker(int i, string d, string s, string c, string u) : 
@@ -91,10 +305,179 @@ public:
         return isDeleted;
     }
     
-    void display() const {
+    // Call visit(name, value) for every field encoded in extra
+    template <typename F>
+    static void forEachField(string_view extra, F visit) {
+        size_t pos = 0;
+        while (pos < extra.size()) {
+            size_t nameEnd = extra.find('\0', pos);
+            size_t valueEnd = extra.find('\0', nameEnd + 1);
+            visit(extra.substr(pos, nameEnd - pos), extra.substr(nameEnd + 1, valueEnd - nameEnd - 1));
+            pos = valueEnd + 1;
+        }
+    }
+    
+    // Value of an optional field, empty if it is not set
+    string field(string_view name) const {
+        string value;
+        forEachField(extra, [&](string_view n, string_view v) {
+            if (n == name) value = string(v);
+        });
+        return value;
+    }
+    
+    // Set an optional field; an empty value removes it
+    void setField(string_view name, string_view value) {
+        string updated;
+        bool found = false;
+        forEachField(extra, [&](string_view n, string_view v) {
+            if (n == name) {
+                found = true;
+                v = value;
+            }
+            if (v.empty()) return;
+            updated.append(n.data(), n.size()).append(1, '\0').append(v.data(), v.size()).append(1, '\0');
+        });
+        if (!found && !value.empty()) {
+            updated.append(name.data(), name.size()).append(1, '\0').append(value.data(), value.size()).append(1, '\0');
+        }
+        extra = move(updated);
+    }
+    
+    // Labels from the "tags" field, which holds them comma-separated
+    vector<string> tags() const {
+        vector<string> list;
+        string value = field("tags");
+        size_t start = 0;
+        while (start < value.size()) {
+            size_t end = value.find(',', start);
+            if (end == string::npos) end = value.size();
+            if (end > start) list.push_back(value.substr(start, end - start));
+            start = end + 1;
+        }
+        return list;
+    }
+    
+    // Add (or with on false, remove) tag; false if nothing changed
+    bool setTag(const string& tag, bool on) {
+        vector<string> list = tags();
+        auto it = find(list.begin(), list.end(), tag);
+        if ((it != list.end()) == on) return false;
+        if (on) list.push_back(tag);
+        else list.erase(it);
+        string value;
+        for (const string& t : list) value += (value.empty() ? "" : ",") + t;
+        setField("tags", value);
+        return true;
+    }
+    
+    // Higher comes first in "next"; 0 unless set
+    int priority() const {
+        return atoi(field("priority").c_str());
+    }
+    
+    // Id of the task this is a subtask of, 0 for none
+    int parentId() const {
+        return atoi(field("parent").c_str());
+    }
+    
+    // Ids of the tasks this one waits for, from the comma-separated "deps"
+    vector<int> dependencies() const {
+        vector<int> ids;
+        string value = field("deps");
+        size_t pos = 0;
+        while (pos < value.size()) {
+            int dep = atoi(value.c_str() + pos);
+            if (dep > 0) ids.push_back(dep);
+            size_t comma = value.find(',', pos);
+            if (comma == string::npos) break;
+            pos = comma + 1;
+        }
+        return ids;
+    }
+    
+    // Append value as a JSON string. Values come from the command line
+    // (worker names, tags), so quotes, backslashes and control characters
+    // in them are escaped.
+    static void appendJsonString(string& json, string_view value) {
+        json += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                json += '\\';
+                json += c;
+            } else if (c == '\n') {
+                json += "\\n";
+            } else if (c == '\t') {
+                json += "\\t";
+            } else if ((unsigned char)c < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+                json += code;
+            } else {
+                json += c;
+            }
+        }
+        json += '"';
+    }
+    
+    static bool isInteger(string_view value) {
+        size_t start = !value.empty() && value[0] == '-' ? 1 : 0;
+        if (start == value.size()) return false;
+        for (size_t i = start; i < value.size(); i++) {
+            if (!isdigit((unsigned char)value[i])) return false;
+        }
+        return true;
+    }
+    
+    // The optional fields as JSON members, each preceded by separator:
+    // priority and parent as numbers, deps and tags (comma-separated in
+    // extra) as arrays of numbers and strings, anything else as a string
+    string fieldsJson(const char* separator) const {
+        string json;
+        auto item = [&](string_view value) {
+            if (isInteger(value)) json.append(value.data(), value.size());
+            else appendJsonString(json, value);
+        };
+        forEachField(extra, [&](string_view name, string_view value) {
+            json += separator;
+            json += "\"" + string(name) + "\": ";
+            if (name == "priority" || name == "parent") {
+                item(value);
+            }
+            else if (name == "deps" || name == "tags") {
+                json += '[';
+                size_t start = 0;
+                while (start < value.size()) {
+                    size_t end = min(value.find(',', start), value.size());
+                    if (start > 0) json += ", ";
+                    if (name == "deps") item(value.substr(start, end - start));
+                    else appendJsonString(json, value.substr(start, end - start));
+                    start = end + 1;
+                }
+                json += ']';
+            }
+            else {
+                appendJsonString(json, value);
+            }
+        });
+        return json;
+    }
+    
+    // The optional fields for display, " | Worker: w1" and so on
+    static string fieldsText(string_view extra) {
+        string text;
+        forEachField(extra, [&](string_view name, string_view value) {
+            text += " | ";
+            text += (char)toupper((unsigned char)name[0]);
+            text.append(name.data() + 1, name.size() - 1).append(": ").append(value.data(), value.size());
+        });
+        return text;
+    }
+    
+    void display(ostream& out = cout) const {
         if (!isDeleted) {
-            cout << "ID: " << id << " | " << desc << " | Status: " << status 
-            << " | Created: " << createdAt << " | Updated: " << updatedAt << endl;
+            out << "ID: " << id << " | " << desc << " | Status: " << status 
+            << " | Created: " << createdAt << " | Updated: " << updatedAt << fieldsText(extra) << endl;
         }
     }
     
@@ -105,256 +488,6178 @@ public:
                "    \"description\": \"" + desc + "\",\n" +
                "    \"status\": \"" + status + "\",\n" +
                "    \"createdAt\": \"" + createdAt + "\",\n" +
-               "    \"updatedAt\": \"" + updatedAt + "\"\n  }";
+               "    \"updatedAt\": \"" + updatedAt + "\"" + fieldsJson(",\n    ") + "\n  }";
+    }
+    
+    // Convert task to a single-line JSON object (NDJSON files, archive segments)
+    string toCompactJson() const {
+        return "{\"id\": " + to_string(id) + ", \"description\": \"" + desc +
+               "\", \"status\": \"" + status + "\", \"createdAt\": \"" + createdAt +
+               "\", \"updatedAt\": \"" + updatedAt + "\"" + fieldsJson(", ") + "}";
     }
 };
 
-class TaskManager {
+// Append-only sequence stored in fixed-size chunks. Growing it allocates a
+// new chunk instead of reallocating, so existing elements are never moved
+// (no copy spikes, no doubled peak memory) and references to them stay
+// valid. CHUNK is a power of two, so indexing is a shift and a mask.
+template <typename T, size_t CHUNK = 1024>
+class ChunkedVector {
 private:
-    vector<TaskTracker> tasks;
-    string filename = "tasks.json";
-    int nextId = 1;
-    
-    string getCurrentTime() {
-        time_t now = time(0);
-        char* dt = ctime(&now);
-        string timeStr(dt);
-        timeStr.pop_back(); // Remove newline
-        return timeStr;
-    }
+    vector<vector<T>> chunks;
+    size_t count = 0;
     
-    void loadTasks() {
-        ifstream file(filename);
-        if (!file.is_open()) {
-            return; // File doesn't exist yet
-        }
+public:
+    template <typename Owner, typename Value>
+    class Iterator {
+    private:
+        Owner* owner;
+        size_t index;
         
-        string line, content = "";
-        while (getline(file, line)) {
-            content += line + "\n";
+    public:
+        Iterator(Owner* o, size_t i) : owner(o), index(i) {}
+        Value& operator*() const { return (*owner)[index]; }
+        Value* operator->() const { return &(*owner)[index]; }
+        Iterator& operator++() { index++; return *this; }
+        bool operator!=(const Iterator& other) const { return index != other.index; }
+        bool operator==(const Iterator& other) const { return index == other.index; }
+    };
+    typedef Iterator<ChunkedVector, T> iterator;
+    typedef Iterator<const ChunkedVector, const T> const_iterator;
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    
+    T& operator[](size_t i) { return chunks[i / CHUNK][i % CHUNK]; }
+    const T& operator[](size_t i) const { return chunks[i / CHUNK][i % CHUNK]; }
+    
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, count); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+    
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (count % CHUNK == 0) {
+            chunks.emplace_back();
+            chunks.back().reserve(CHUNK);
         }
-        file.close();
-        
-        if (content.empty() || content.find("[]") != string::npos) {
-            return;
+        chunks.back().emplace_back(forward<Args>(args)...);
+        count++;
+        return chunks.back().back();
+    }
+    
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(move(value)); }
+    
+    // Move every element of other to the end; takes its chunks as they are
+    // when this is empty
+    void append(ChunkedVector&& other) {
+        if (count == 0) {
+            swap(chunks, other.chunks);
+            swap(count, other.count);
         }
-        
-        // Simple JSON parsing (basic implementation)
-        size_t pos = 0;
-        while ((pos = content.find("\"id\":", pos)) != string::npos) {
-            size_t idStart = content.find(":", pos) + 1;
-            size_t idEnd = content.find(",", idStart);
-            int id = stoi(content.substr(idStart, idEnd - idStart));
-            
-            size_t descStart = content.find("\"description\": \"", pos) + 16;
-            size_t descEnd = content.find("\"", descStart);
-            string desc = content.substr(descStart, descEnd - descStart);
-            
-            size_t statusStart = content.find("\"status\": \"", pos) + 11;
-            size_t statusEnd = content.find("\"", statusStart);
-            string status = content.substr(statusStart, statusEnd - statusStart);
-            
-            size_t createdStart = content.find("\"createdAt\": \"", pos) + 14;
-            size_t createdEnd = content.find("\"", createdStart);
-            string createdAt = content.substr(createdStart, createdEnd - createdStart);
-            
-            size_t updatedStart = content.find("\"updatedAt\": \"", pos) + 14;
-            size_t updatedEnd = content.find("\"", updatedStart);
-            string updatedAt = content.substr(updatedStart, updatedEnd - updatedStart);
-            
-            tasks.push_back(TaskTracker(id, desc, status, createdAt, updatedAt));
-            nextId = max(nextId, id + 1);
-            pos = updatedEnd;
+        else {
+            for (T& value : other) emplace_back(move(value));
         }
+        other.clear();
     }
     
-    void saveTasks() {
-        ofstream file(filename);
-        file << "[\n";
-        
-        bool first = true;
-        for (const auto& task : tasks) {
-            if (!task.isTaskDeleted()) {
-                if (!first) file << ",\n";
-                file << task.toJson();
-                first = false;
-            }
-        }
-        
-        file << "\n]";
-        file.close();
+    void clear() {
+        chunks.clear();
+        count = 0;
     }
+};
+
+// Ordered index from a timestamp's clockKey to task ids, so range queries
+// in a long-lived process cost O(log N + k)
+class TimeIndex {
+private:
+    set<pair<int64_t, size_t>> entries;
     
 public:
-    TaskManager() {
-        loadTasks();
+    void insert(int64_t key, size_t id) {
+        if (key != -1) entries.insert({key, id});
     }
     
-    void addTask(string description) {
-        string currentTime = getCurrentTime();
-        TaskTracker newTask(nextId++);
-        newTask.addTask(description, "todo", currentTime, currentTime);
-        tasks.push_back(newTask);
-        saveTasks();
-        cout << "Task added successfully (ID: " << newTask.getId() << ")" << endl;
+    void erase(int64_t key, size_t id) {
+        if (key != -1) entries.erase({key, id});
     }
     
-    void updateTask(int id, string description) {
-        for (auto& task : tasks) {
-            if (task.getId() == id && !task.isTaskDeleted()) {
-                task.updateDescription(description, getCurrentTime());
-                saveTasks();
-                cout << "Task updated successfully" << endl;
-                return;
-            }
-        }
-        cout << "Task with ID " << id << " not found" << endl;
+    void clear() {
+        entries.clear();
     }
     
-    void deleteTask(int id) {
-        for (auto& task : tasks) {
-            if (task.getId() == id && !task.isTaskDeleted()) {
-                task.deleteTask();
-                saveTasks();
-                cout << "Task deleted successfully" << endl;
-                return;
-            }
+    // Visit ids with lo <= time <= hi in time order
+    template <typename F>
+    void range(int64_t lo, int64_t hi, F visit) const {
+        auto it = entries.lower_bound({lo, 0});
+        for (; it != entries.end() && it->first <= hi; ++it) {
+            visit(it->second);
         }
-        cout << "Task with ID " << id << " not found" << endl;
     }
+};
+
+// Hierarchical timing wheel over whole seconds: LEVELS wheels of SLOTS
+// slots, where a slot of level k spans SLOTS^k seconds. Adding a timer and
+// advancing by one tick are O(1) however many timers are pending; a timer
+// moves down a level at most LEVELS - 1 times before it fires. Timers due
+// beyond the top level wait in its furthest slot and are placed again.
+// There is at most one timer per id: adding one replaces the old, and
+// removing it is O(1) since each id's slot and position are kept.
+class TimerWheel {
+private:
+    static const int BITS = 6;
+    static const int SLOTS = 1 << BITS;
+    static const int LEVELS = 4;
     
-    void markInProgress(int id) {
-        for (auto& task : tasks) {
-            if (task.getId() == id && !task.isTaskDeleted()) {
-                task.updateStatus("in-progress", getCurrentTime());
-                saveTasks();
-                cout << "Task marked as in progress" << endl;
+    struct Timer {
+        int id;
+        int64_t due;
+    };
+    
+    vector<Timer> slots[LEVELS][SLOTS];
+    unordered_map<int, pair<int, size_t>> where;    // id -> level * SLOTS + slot, index
+    int64_t now;
+    
+    // File timer no earlier than the slot for time earliest
+    void place(const Timer& timer, int64_t earliest) {
+        int64_t due = max(timer.due, earliest);
+        for (int level = 0; level < LEVELS; level++) {
+            if (due - now < ((int64_t)SLOTS << (BITS * level)) || level == LEVELS - 1) {
+                int64_t at = min(due, now + ((int64_t)SLOTS << (BITS * level)) - 1);
+                int cell = level * SLOTS + ((at >> (BITS * level)) & (SLOTS - 1));
+                where[timer.id] = { cell, slots[level][cell % SLOTS].size() };
+                slots[level][cell % SLOTS].push_back(timer);
                 return;
             }
         }
-        cout << "Task with ID " << id << " not found" << endl;
     }
     
-    void markDone(int id) {
-        for (auto& task : tasks) {
-            if (task.getId() == id && !task.isTaskDeleted()) {
-                task.updateStatus("done", getCurrentTime());
-                saveTasks();
-                cout << "Task marked as done" << endl;
-                return;
-            }
-        }
-        cout << "Task with ID " << id << " not found" << endl;
+public:
+    explicit TimerWheel(int64_t start = 0) : now(start) {}
+    
+    size_t size() const {
+        return where.size();
     }
     
-    void listAllTasks() {
-        bool found = false;
-        for (const auto& task : tasks) {
-            if (!task.isTaskDeleted()) {
-                task.display();
-                found = true;
-            }
-        }
-        if (!found) {
-            cout << "No tasks found" << endl;
+    // Set id's timer to fire at due, replacing any it had
+    void add(int id, int64_t due) {
+        remove(id);
+        place({id, due}, now + 1);
+    }
+    
+    void remove(int id) {
+        auto it = where.find(id);
+        if (it == where.end()) return;
+        vector<Timer>& slot = slots[it->second.first / SLOTS][it->second.first % SLOTS];
+        size_t index = it->second.second;
+        where.erase(it);
+        if (index + 1 < slot.size()) {
+            slot[index] = slot.back();
+            where[slot[index].id].second = index;
         }
+        slot.pop_back();
     }
     
-    void listTasksByStatus(string status) {
-        bool found = false;
-        for (const auto& task : tasks) {
-            if (!task.isTaskDeleted() && task.status == status) {
-                task.display();
-                found = true;
+    // Move time forward to t, calling fire(id) for every timer due by then.
+    // fire must not add or remove timers.
+    template <typename F>
+    void advance(int64_t t, F fire) {
+        // Nothing pending: jump instead of stepping through the gap
+        if (where.empty() && t > now) now = t;
+        while (now < t) {
+            now++;
+            for (int level = LEVELS - 1; level > 0; level--) {
+                if ((now & (((int64_t)1 << (BITS * level)) - 1)) != 0) continue;
+                vector<Timer> moved;
+                moved.swap(slots[level][(now >> (BITS * level)) & (SLOTS - 1)]);
+                for (const Timer& timer : moved) place(timer, now);
+            }
+            
+            vector<Timer> due;
+            due.swap(slots[0][now & (SLOTS - 1)]);
+            for (const Timer& timer : due) {
+                if (timer.due > now) {
+                    place(timer, now + 1);
+                    continue;
+                }
+                where.erase(timer.id);
+                fire(timer.id);
             }
-        }
-        if (!found) {
-            cout << "No tasks found with status: " << status << endl;
         }
     }
 };
 
-void printUsage() {
-    cout << "Usage:" << endl;
-    cout << "  task-cli add \"description\"        - Add a new task" << endl;
-    cout << "  task-cli update <id> \"description\" - Update task description" << endl;
-    cout << "  task-cli delete <id>               - Delete a task" << endl;
-    cout << "  task-cli mark-in-progress <id>     - Mark task as in progress" << endl;
-    cout << "  task-cli mark-done <id>            - Mark task as done" << endl;
-    cout << "  task-cli list                      - List all tasks" << endl;
-    cout << "  task-cli list done                 - List completed tasks" << endl;
-    cout << "  task-cli list todo                 - List todo tasks" << endl;
-    cout << "  task-cli list in-progress          - List in-progress tasks" << endl;
-}
-
-int main(int argc, char* argv[]) {
-    TaskManager manager;
+// Binary max-heap of task ids by (priority, then lowest id), with each id's
+// position kept so a task can be re-prioritised or removed in O(log n)
+class IndexedHeap {
+private:
+    struct Entry {
+        int priority;
+        int id;
+        
+        bool above(const Entry& other) const {
+            return priority != other.priority ? priority > other.priority : id < other.id;
+        }
+    };
     
-    if (argc < 2) {
-        printUsage();
-        return 1;
-    }
+    vector<Entry> heap;
+    unordered_map<int, size_t> position;
     
-    string command = argv[1];
+    void put(size_t i, const Entry& entry) {
+        heap[i] = entry;
+        position[entry.id] = i;
+    }
     
-    if (command == "add") {
-        if (argc < 3) {
-            cout << "Error: Please provide a task description" << endl;
-            return 1;
+    void siftUp(size_t i) {
+        Entry entry = heap[i];
+        while (i > 0 && entry.above(heap[(i - 1) / 2])) {
+            put(i, heap[(i - 1) / 2]);
+            i = (i - 1) / 2;
         }
-        manager.addTask(argv[2]);
+        put(i, entry);
     }
-    else if (command == "update") {
-        if (argc < 4) {
-            cout << "Error: Please provide task ID and new description" << endl;
-            return 1;
+    
+    void siftDown(size_t i) {
+        Entry entry = heap[i];
+        for (;;) {
+            size_t child = 2 * i + 1;
+            if (child >= heap.size()) break;
+            if (child + 1 < heap.size() && heap[child + 1].above(heap[child])) child++;
+            if (!heap[child].above(entry)) break;
+            put(i, heap[child]);
+            i = child;
         }
-        int id = stoi(argv[2]);
-        manager.updateTask(id, argv[3]);
+        put(i, entry);
     }
-    else if (command == "delete") {
-        if (argc < 3) {
-            cout << "Error: Please provide task ID" << endl;
-            return 1;
-        }
-        int id = stoi(argv[2]);
-        manager.deleteTask(id);
+    
+public:
+    bool empty() const {
+        return heap.empty();
     }
-    else if (command == "mark-in-progress") {
-        if (argc < 3) {
-            cout << "Error: Please provide task ID" << endl;
-            return 1;
-        }
-        int id = stoi(argv[2]);
-        manager.markInProgress(id);
+    
+    size_t size() const {
+        return heap.size();
     }
-    else if (command == "mark-done") {
-        if (argc < 3) {
-            cout << "Error: Please provide task ID" << endl;
-            return 1;
+    
+    // Id of the highest-priority entry; the heap must not be empty
+    int top() const {
+        return heap[0].id;
+    }
+    
+    // Insert id, or move it if already present
+    void set(int id, int priority) {
+        auto it = position.find(id);
+        if (it == position.end()) {
+            heap.push_back({priority, id});
+            siftUp(heap.size() - 1);
+            return;
         }
-        int id = stoi(argv[2]);
-        manager.markDone(id);
+        size_t i = it->second;
+        int old = heap[i].priority;
+        heap[i].priority = priority;
+        if (priority > old) siftUp(i);
+        else if (priority < old) siftDown(i);
     }
-    else if (command == "list") {
-        if (argc == 2) {
-            manager.listAllTasks();
+    
+    void remove(int id) {
+        auto it = position.find(id);
+        if (it == position.end()) return;
+        size_t i = it->second;
+        position.erase(it);
+        Entry last = heap.back();
+        heap.pop_back();
+        if (i == heap.size()) return;
+        put(i, last);
+        if (i > 0 && last.above(heap[(i - 1) / 2])) siftUp(i);
+        else siftDown(i);
+    }
+    
+    // Replace the contents with entries in one O(n) heapify
+    void build(vector<pair<int, int>> entries) {
+        heap.clear();
+        position.clear();
+        position.reserve(entries.size());
+        for (const auto& entry : entries) heap.push_back({entry.second, entry.first});
+        for (size_t i = 0; i < heap.size(); i++) position[heap[i].id] = i;
+        for (size_t i = heap.size() / 2; i-- > 0;) siftDown(i);
+    }
+};
+
+// Compressed set of task ids in the style of Roaring bitmaps: ids are split
+// by their high 16 bits into containers, each a sorted array of low halves
+// while it holds at most ARRAY_MAX of them and a 65536-bit bitset once it
+// holds more. Sparse and dense sets both stay small, and intersecting two
+// sets works container by container (merge, probe or word-wise AND with
+// popcount) without touching ids that cannot match.
+class RoaringBitmap {
+private:
+    static const size_t ARRAY_MAX = 4096;
+    static const size_t WORDS = 65536 / 64;
+    
+    struct Container {
+        vector<uint16_t> array;
+        vector<uint64_t> bits; // WORDS words once the container is a bitset
+        size_t count = 0;
+        
+        bool isBitset() const {
+            return !bits.empty();
+        }
+        
+        bool contains(uint16_t low) const {
+            if (isBitset()) return (bits[low >> 6] >> (low & 63)) & 1;
+            return binary_search(array.begin(), array.end(), low);
+        }
+        
+        void add(uint16_t low) {
+            if (isBitset()) {
+                uint64_t bit = (uint64_t)1 << (low & 63);
+                if (!(bits[low >> 6] & bit)) count++;
+                bits[low >> 6] |= bit;
+                return;
+            }
+            auto it = lower_bound(array.begin(), array.end(), low);
+            if (it != array.end() && *it == low) return;
+            array.insert(it, low);
+            count++;
+            if (count > ARRAY_MAX) {
+                bits.assign(WORDS, 0);
+                for (uint16_t v : array) bits[v >> 6] |= (uint64_t)1 << (v & 63);
+                vector<uint16_t>().swap(array);
+            }
+        }
+        
+        void remove(uint16_t low) {
+            if (isBitset()) {
+                uint64_t bit = (uint64_t)1 << (low & 63);
+                if (bits[low >> 6] & bit) count--;
+                bits[low >> 6] &= ~bit;
+                if (count <= ARRAY_MAX / 2) {
+                    forEach([&](uint16_t v) { array.push_back(v); });
+                    vector<uint64_t>().swap(bits);
+                }
+                return;
+            }
+            auto it = lower_bound(array.begin(), array.end(), low);
+            if (it == array.end() || *it != low) return;
+            array.erase(it);
+            count--;
         }
-        else if (argc == 3) {
-            string status = argv[2];
-            if (status == "in-progress") {
-                manager.listTasksByStatus("in-progress");
+        
+        template <typename F>
+        void forEach(F visit) const {
+            if (!isBitset()) {
+                for (uint16_t v : array) visit(v);
+                return;
+            }
+            for (size_t w = 0; w < WORDS; w++) {
+                for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+                    visit((uint16_t)(w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        }
+        
+        static Container intersect(const Container& a, const Container& b) {
+            Container out;
+            if (a.isBitset() && b.isBitset()) {
+                for (size_t w = 0; w < WORDS; w++) out.count += __builtin_popcountll(a.bits[w] & b.bits[w]);
+                if (out.count > ARRAY_MAX) {
+                    out.bits.resize(WORDS);
+                    for (size_t w = 0; w < WORDS; w++) out.bits[w] = a.bits[w] & b.bits[w];
+                }
+                else {
+                    out.array.reserve(out.count);
+                    for (size_t w = 0; w < WORDS; w++) {
+                        for (uint64_t word = a.bits[w] & b.bits[w]; word != 0; word &= word - 1) {
+                            out.array.push_back((uint16_t)(w * 64 + __builtin_ctzll(word)));
+                        }
+                    }
+                }
+            }
+            else if (a.isBitset() || b.isBitset()) {
+                const Container& bitset = a.isBitset() ? a : b;
+                const Container& sparse = a.isBitset() ? b : a;
+                for (uint16_t v : sparse.array) {
+                    if (bitset.contains(v)) out.array.push_back(v);
+                }
+                out.count = out.array.size();
             }
             else {
-                manager.listTasksByStatus(status);
+                set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                                 back_inserter(out.array));
+                out.count = out.array.size();
             }
+            return out;
         }
+    };
+    
+    map<uint16_t, Container> containers;
+    size_t total = 0;
+    
+public:
+    size_t size() const {
+        return total;
     }
-    else {
-        cout << "Error: Unknown command '" << command << "'" << endl;
-        printUsage();
-        return 1;
+    
+    bool contains(uint32_t id) const {
+        auto it = containers.find((uint16_t)(id >> 16));
+        return it != containers.end() && it->second.contains((uint16_t)id);
     }
     
-    return 0;
-}
\ No newline at end of file
+    void add(uint32_t id) {
+        Container& container = containers[(uint16_t)(id >> 16)];
+        total -= container.count;
+        container.add((uint16_t)id);
+        total += container.count;
+    }
+    
+    void remove(uint32_t id) {
+        auto it = containers.find((uint16_t)(id >> 16));
+        if (it == containers.end()) return;
+        total -= it->second.count;
+        it->second.remove((uint16_t)id);
+        total += it->second.count;
+        if (it->second.count == 0) containers.erase(it);
+    }
+    
+    RoaringBitmap operator&(const RoaringBitmap& other) const {
+        RoaringBitmap out;
+        auto a = containers.begin();
+        auto b = other.containers.begin();
+        while (a != containers.end() && b != other.containers.end()) {
+            if (a->first < b->first) ++a;
+            else if (b->first < a->first) ++b;
+            else {
+                Container both = Container::intersect(a->second, b->second);
+                if (both.count > 0) {
+                    out.total += both.count;
+                    out.containers.emplace(a->first, move(both));
+                }
+                ++a;
+                ++b;
+            }
+        }
+        return out;
+    }
+    
+    // Visit the ids in ascending order
+    template <typename F>
+    void forEach(F visit) const {
+        for (const auto& container : containers) {
+            uint32_t high = (uint32_t)container.first << 16;
+            container.second.forEach([&](uint16_t low) { visit(high | low); });
+        }
+    }
+};
+
+// Heap allocation counters fed by the replacement operator new/delete below.
+// Counting only happens while --stats is active.
+struct AllocCounters {
+    atomic<bool> enabled{false};
+    atomic<size_t> allocs{0};
+    atomic<size_t> bytes{0};
+    atomic<size_t> frees{0};
+};
+
+AllocCounters allocCounters;
+
+void* operator new(size_t size) {
+    if (allocCounters.enabled.load(memory_order_relaxed)) {
+        allocCounters.allocs.fetch_add(1, memory_order_relaxed);
+        allocCounters.bytes.fetch_add(size, memory_order_relaxed);
+    }
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p != nullptr && allocCounters.enabled.load(memory_order_relaxed)) {
+        allocCounters.frees.fetch_add(1, memory_order_relaxed);
+    }
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+// Reads the process-wide read/write syscall counters from /proc/self/io.
+// Each sample is itself one read syscall, which sample() leaves out.
+class SyscallCounter {
+private:
+    int fd = -1;
+    size_t samples = 0;
+    
+public:
+    bool open() {
+        fd = ::open("/proc/self/io", O_RDONLY);
+        return fd >= 0;
+    }
+    
+    // False if the counters are unavailable (not Linux, no procfs)
+    bool sample(size_t& reads, size_t& writes) {
+        if (fd < 0) return false;
+        char buf[512];
+        ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (n <= 0) return false;
+        buf[n] = '\0';
+        const char* r = strstr(buf, "syscr: ");
+        const char* w = strstr(buf, "syscw: ");
+        if (r == nullptr || w == nullptr) return false;
+        samples++;
+        reads = strtoull(r + 7, nullptr, 10) - samples;
+        writes = strtoull(w + 7, nullptr, 10);
+        return true;
+    }
+};
+
+// Phases of a command that --timings and --stats report separately
+enum Phase {
+    PHASE_OTHER,
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_LOOKUP,
+    PHASE_SERIALIZE,
+    PHASE_WRITE,
+    PHASE_OUTPUT,
+    PHASE_COUNT
+};
+
+const char* PHASE_NAMES[PHASE_COUNT] = {
+    "other", "read", "parse", "lookup", "serialize", "write", "output"
+};
+
+// Per-phase wall time on a monotonic clock, plus heap allocations and
+// read/write syscalls when --stats is on. Phases nest: entering a phase
+// pauses the enclosing one, so every nanosecond (and every allocation) is
+// charged to exactly one phase.
+class Timings {
+private:
+    typedef chrono::steady_clock Clock;
+    
+    struct Totals {
+        Clock::duration time = {};
+        size_t allocs = 0;
+        size_t allocBytes = 0;
+        size_t frees = 0;
+        size_t reads = 0;
+        size_t writes = 0;
+    };
+    
+    bool enabled = false;
+    bool stats = false;
+    bool haveSyscalls = false;
+    Clock::time_point start;
+    Clock::time_point mark;
+    size_t markAllocs = 0, markBytes = 0, markFrees = 0, markReads = 0, markWrites = 0;
+    vector<Phase> stack;
+    Totals spent[PHASE_COUNT];
+    SyscallCounter syscalls;
+    
+    void charge() {
+        Totals& t = spent[stack.empty() ? PHASE_OTHER : stack.back()];
+        Clock::time_point now = Clock::now();
+        t.time += now - mark;
+        mark = now;
+        
+        if (!stats) return;
+        size_t allocs = allocCounters.allocs.load(memory_order_relaxed);
+        size_t bytes = allocCounters.bytes.load(memory_order_relaxed);
+        size_t frees = allocCounters.frees.load(memory_order_relaxed);
+        t.allocs += allocs - markAllocs;
+        t.allocBytes += bytes - markBytes;
+        t.frees += frees - markFrees;
+        markAllocs = allocs;
+        markBytes = bytes;
+        markFrees = frees;
+        
+        size_t reads, writes;
+        if (haveSyscalls && syscalls.sample(reads, writes)) {
+            t.reads += reads - markReads;
+            t.writes += writes - markWrites;
+            markReads = reads;
+            markWrites = writes;
+        }
+    }
+    
+    void printRow(ostream& out, const char* name, const Totals& t) {
+        char line[160];
+        int len = snprintf(line, sizeof(line), "  %-10s %10.3f", name,
+                           chrono::duration<double, milli>(t.time).count());
+        if (stats) {
+            snprintf(line + len, sizeof(line) - len, " %9zu %11.1f %9zu %8zu %8zu",
+                     t.allocs, t.allocBytes / 1024.0, t.frees, t.reads, t.writes);
+        }
+        out << line;
+    }
+    
+public:
+    size_t bytesRead = 0;
+    size_t bytesWritten = 0;
+    size_t tasksLoaded = 0;
+    size_t tasksSaved = 0;
+    size_t tasksScanned = 0;
+    size_t linesOutput = 0;
+    
+    bool isEnabled() const {
+        return enabled;
+    }
+    
+    void enable(bool withStats) {
+        enabled = true;
+        stats = withStats;
+        stack.reserve(16);
+        if (stats) {
+            haveSyscalls = syscalls.open() && syscalls.sample(markReads, markWrites);
+            allocCounters.enabled = true;
+        }
+        start = mark = Clock::now();
+    }
+    
+    void enter(Phase phase) {
+        if (!enabled) return;
+        charge();
+        stack.push_back(phase);
+    }
+    
+    void leave() {
+        if (!enabled) return;
+        charge();
+        stack.pop_back();
+    }
+    
+    void report(ostream& out) {
+        if (!enabled) return;
+        charge();
+        allocCounters.enabled = false;
+        
+        Totals total;
+        total.time = mark - start;
+        for (const Totals& t : spent) {
+            total.allocs += t.allocs;
+            total.allocBytes += t.allocBytes;
+            total.frees += t.frees;
+            total.reads += t.reads;
+            total.writes += t.writes;
+        }
+        
+        if (stats) {
+            char header[160];
+            snprintf(header, sizeof(header), "  %-10s %10s %9s %11s %9s %8s %8s", "stats:",
+                     "time ms", "allocs", "alloc KiB", "frees", "read(2)", "write(2)");
+            out << header << endl;
+        }
+        else {
+            out << "timings (ms):" << endl;
+        }
+        for (int p = PHASE_READ; p < PHASE_COUNT; p++) {
+            printRow(out, PHASE_NAMES[p], spent[p]);
+            if (p == PHASE_READ) out << "  " << bytesRead << " bytes";
+            if (p == PHASE_PARSE) out << "  " << tasksLoaded << " tasks";
+            if (p == PHASE_LOOKUP) out << "  " << tasksScanned << " tasks scanned";
+            if (p == PHASE_SERIALIZE) out << "  " << tasksSaved << " tasks";
+            if (p == PHASE_WRITE) out << "  " << bytesWritten << " bytes";
+            if (p == PHASE_OUTPUT) out << "  " << linesOutput << " lines";
+            out << endl;
+        }
+        printRow(out, "other", spent[PHASE_OTHER]);
+        out << endl;
+        printRow(out, "total", total);
+        out << endl;
+        if (stats && !haveSyscalls) {
+            out << "  (syscall counts unavailable: cannot read /proc/self/io)" << endl;
+        }
+    }
+};
+
+Timings timings;
+
+// Charges the enclosing scope to a phase
+class ScopedPhase {
+public:
+    explicit ScopedPhase(Phase phase) {
+        timings.enter(phase);
+    }
+    
+    ~ScopedPhase() {
+        timings.leave();
+    }
+};
+
+// Read a whole file into content; false if it cannot be opened
+bool readFile(const string& path, string& content) {
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) return false;
+    file.seekg(0, ios::end);
+    content.resize((size_t)file.tellg());
+    file.seekg(0, ios::beg);
+    file.read(&content[0], content.size());
+    return true;
+}
+
+// Flush a file's data to stable storage
+void syncFile(const string& path) {
+    ScopedPhase phase(PHASE_WRITE);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    close(fd);
+}
+
+// Position of the quote closing the JSON string that starts at start (just
+// past its opening quote), skipping escaped characters; npos if unterminated
+size_t closingQuote(string_view text, size_t start) {
+    for (size_t pos = start; pos < text.size(); pos++) {
+        if (text[pos] == '\\') pos++;
+        else if (text[pos] == '"') return pos;
+    }
+    return string::npos;
+}
+
+// Undo the escaping fieldsJson applies to a value
+string unescapeJson(string_view text) {
+    if (text.find('\\') == string_view::npos) return string(text);
+    string out;
+    for (size_t pos = 0; pos < text.size(); pos++) {
+        if (text[pos] != '\\' || pos + 1 == text.size()) {
+            out += text[pos];
+            continue;
+        }
+        char c = text[++pos];
+        if (c == 'n') out += '\n';
+        else if (c == 't') out += '\t';
+        else if (c == 'r') out += '\r';
+        else if (c == 'u' && pos + 4 < text.size()) {
+            out += (char)strtol(string(text.substr(pos + 1, 4)).c_str(), nullptr, 16);
+            pos += 4;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// Read the optional field member whose name starts at pos (its opening
+// quote): "name": then a string, a number or an array of them. Stores the
+// name, and the value as TaskTracker::extra holds it (array items joined by
+// commas), if asked to; returns the position of the member's last character,
+// or npos if it is cut off.
+size_t readField(string_view text, size_t pos, string* name, string* value) {
+    size_t nameEnd = pos == string::npos ? pos : text.find('"', pos + 1);
+    size_t colon = nameEnd == string::npos ? nameEnd : text.find(':', nameEnd);
+    size_t start = colon == string::npos ? colon : text.find_first_not_of(" \t\r\n", colon + 1);
+    if (start == string::npos) return start;
+    if (name != nullptr) *name = string(text.substr(pos + 1, nameEnd - pos - 1));
+    if (value != nullptr) value->clear();
+    
+    // One string or bare number; returns its last character
+    auto item = [&](size_t at) {
+        if (text[at] == '"') {
+            size_t end = closingQuote(text, at + 1);
+            if (end != string::npos && value != nullptr) *value += unescapeJson(text.substr(at + 1, end - at - 1));
+            return end;
+        }
+        size_t end = text.find_first_of(",]} \t\r\n", at);
+        if (end == string::npos) return end;
+        if (value != nullptr) value->append(text.data() + at, end - at);
+        return end - 1;
+    };
+    if (text[start] != '[') return item(start);
+    
+    size_t at = text.find_first_not_of(" \t\r\n", start + 1);
+    for (bool first = true; at != string::npos && text[at] != ']'; first = false) {
+        if (!first && value != nullptr) *value += ',';
+        size_t end = item(at);
+        if (end == string::npos) return end;
+        at = text.find_first_not_of(" \t\r\n", end + 1);
+        if (at != string::npos && text[at] == ',') at = text.find_first_not_of(" \t\r\n", at + 1);
+    }
+    return at;
+}
+
+// Parse tasks written by saveTasks (JSON array or NDJSON), calling onTask for
+// every task. Does not touch the global timings, so it is safe to run on
+// worker threads over separate slices of one buffer.
+template <typename F>
+void parseTasks(string_view content, F onTask) {
+    // Simple JSON parsing (basic implementation)
+    size_t pos = 0;
+    while ((pos = content.find("\"id\":", pos)) != string::npos) {
+        size_t idStart = content.find(":", pos) + 1;
+        size_t idEnd = content.find(",", idStart);
+        int id = stoi(string(content.substr(idStart, idEnd - idStart)));
+        
+        size_t descStart = content.find("\"description\": \"", pos) + 16;
+        size_t descEnd = content.find("\"", descStart);
+        string desc(content.substr(descStart, descEnd - descStart));
+        
+        size_t statusStart = content.find("\"status\": \"", pos) + 11;
+        size_t statusEnd = content.find("\"", statusStart);
+        string status(content.substr(statusStart, statusEnd - statusStart));
+        
+        size_t createdStart = content.find("\"createdAt\": \"", pos) + 14;
+        size_t createdEnd = content.find("\"", createdStart);
+        string createdAt(content.substr(createdStart, createdEnd - createdStart));
+        
+        size_t updatedStart = content.find("\"updatedAt\": \"", pos) + 14;
+        size_t updatedEnd = content.find("\"", updatedStart);
+        string updatedAt(content.substr(updatedStart, updatedEnd - updatedStart));
+        
+        TaskTracker task(id, desc, status, createdAt, updatedAt);
+        pos = updatedEnd;
+        
+        // Optional fields follow updatedAt (see readField)
+        while (pos + 1 < content.size() && content[pos + 1] == ',') {
+            string name, value;
+            size_t end = readField(content, content.find('"', pos + 1), &name, &value);
+            if (end == string::npos) break;
+            task.setField(name, value);
+            pos = end;
+        }
+        onTask(move(task));
+    }
+}
+
+// True if content is NDJSON (one task object per line) rather than an array
+bool isNdjson(string_view content) {
+    size_t first = content.find_first_not_of(" \t\r\n");
+    return first != string::npos && content[first] == '{';
+}
+
+// Parse NDJSON by splitting it at line boundaries into one slice per thread.
+// Results come back in file order.
+ChunkedVector<TaskTracker> parseNdjsonParallel(string_view content) {
+    size_t threadCount = max(1u, thread::hardware_concurrency());
+    threadCount = min<size_t>(threadCount, content.size() / (4 << 20) + 1);
+    
+    vector<string_view> slices;
+    size_t start = 0;
+    for (size_t t = 1; t <= threadCount && start < content.size(); t++) {
+        size_t end = t == threadCount ? content.size() : content.size() * t / threadCount;
+        end = content.find('\n', max(end, start));
+        end = end == string::npos ? content.size() : end + 1;
+        slices.push_back(content.substr(start, end - start));
+        start = end;
+    }
+    
+    vector<ChunkedVector<TaskTracker>> parsed(slices.size());
+    auto work = [&](size_t i) {
+        parseTasks(slices[i], [&](TaskTracker&& task) { parsed[i].push_back(move(task)); });
+    };
+    vector<thread> threads;
+    for (size_t i = 1; i < slices.size(); i++) threads.emplace_back(work, i);
+    if (!slices.empty()) work(0);
+    for (auto& t : threads) t.join();
+    
+    ChunkedVector<TaskTracker> tasks;
+    for (auto& part : parsed) tasks.append(move(part));
+    return tasks;
+}
+
+// Write tasks in the saveTasks format, or one task per line when ndjson is
+// set. forEach(visit) calls visit(task) for each task to write. Tasks are
+// serialized into a buffer that is written out every 1 MiB, which lets
+// --timings tell serialization apart from file writes.
+template <typename F>
+void writeTasksFile(const string& path, F forEach, bool ndjson = false) {
+    ScopedPhase phase(PHASE_SERIALIZE);
+    ofstream file(path);
+    string buffer = ndjson ? "" : "[\n";
+    
+    auto flush = [&]() {
+        ScopedPhase write(PHASE_WRITE);
+        file.write(buffer.data(), buffer.size());
+        timings.bytesWritten += buffer.size();
+        buffer.clear();
+    };
+    
+    bool first = true;
+    forEach([&](const TaskTracker& task) {
+        if (ndjson) {
+            buffer += task.toCompactJson();
+            buffer += '\n';
+        }
+        else {
+            if (!first) buffer += ",\n";
+            buffer += task.toJson();
+        }
+        first = false;
+        timings.tasksSaved++;
+        if (buffer.size() >= (1 << 20)) flush();
+    });
+    
+    if (!ndjson) buffer += "\n]";
+    flush();
+    ScopedPhase write(PHASE_WRITE);
+    file.close();
+}
+
+// 64-bit hash of a file's bytes, 8 bytes per step. Only has to tell an
+// edited file from the one a parse cache was built from, not resist attacks.
+uint64_t hashContent(string_view data) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ data.size();
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8) {
+        uint64_t word;
+        memcpy(&word, data.data() + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data.data() + i, data.size() - i);
+    h = (h ^ tail) * 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 29);
+}
+
+struct ParseCacheHeader {
+    char magic[8];              // "TTCACH2"
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+    uint64_t hash;              // hashContent of the source file
+    uint64_t count;
+};
+
+// Parsed tasks of a JSON file kept in binary form next to it (tasks.json.cache).
+// The cache is used only while the file's inode, size and mtime match the
+// header and its content hash does too; the hash catches rewrites within
+// one mtime tick. Loading an unchanged file then costs a read, a hash and a
+// bulk decode instead of a JSON parse. Only read-only commands write it, so
+// a command that is about to rewrite the file never pays for the cache too.
+// TASK_CACHE=0 turns it off.
+class ParseCache {
+private:
+    static string cachePath(const string& path) {
+        return path + ".cache";
+    }
+    
+    static bool matches(const ParseCacheHeader& header, const struct stat& st) {
+        return header.inode == (uint64_t)st.st_ino && header.size == (uint64_t)st.st_size &&
+               header.mtimeSec == (int64_t)st.st_mtim.tv_sec &&
+               header.mtimeNsec == (int64_t)st.st_mtim.tv_nsec;
+    }
+    
+public:
+    static bool enabled() {
+        const char* env = getenv("TASK_CACHE");
+        return env == nullptr || strcmp(env, "0") != 0;
+    }
+    
+    // Fill tasks from the cache if it was built from content, the current
+    // contents of path
+    static bool load(const string& path, string_view content, ChunkedVector<TaskTracker>& tasks) {
+        struct stat st;
+        if (!enabled() || stat(path.c_str(), &st) != 0) return false;
+        
+        // Check the header before reading the rest of the cache
+        ParseCacheHeader header;
+        ifstream file(cachePath(path), ios::binary);
+        if (!file.read((char*)&header, sizeof(header)) ||
+            strcmp(header.magic, "TTCACH2") != 0 || !matches(header, st) ||
+            header.hash != hashContent(content)) return false;
+        
+        string data;
+        {
+            ScopedPhase phase(PHASE_READ);
+            file.seekg(0, ios::end);
+            data.resize((size_t)file.tellg() - sizeof(header));
+            file.seekg(sizeof(header), ios::beg);
+            if (!file.read(&data[0], data.size())) return false;
+            timings.bytesRead += sizeof(header) + data.size();
+        }
+        
+        // Each task: id, five lengths, then description, status, createdAt,
+        // updatedAt and the optional fields
+        ChunkedVector<TaskTracker> loaded;
+        size_t pos = 0;
+        while (loaded.size() < header.count) {
+            int32_t id;
+            uint32_t lengths[5];
+            if (pos + 24 > data.size()) return false;
+            memcpy(&id, &data[pos], 4);
+            memcpy(lengths, &data[pos + 4], 20);
+            pos += 24;
+            string fields[5];
+            for (int i = 0; i < 5; i++) {
+                if (pos + lengths[i] > data.size()) return false;
+                fields[i].assign(data, pos, lengths[i]);
+                pos += lengths[i];
+            }
+            loaded.emplace_back(id, move(fields[0]), move(fields[1]), move(fields[2]), move(fields[3]));
+            loaded[loaded.size() - 1].extra = move(fields[4]);
+        }
+        tasks = move(loaded);
+        return true;
+    }
+    
+    // Fill header for path, whose current contents are content, so the cache
+    // can be saved later; false if the cache is off
+    static bool describe(const string& path, string_view content, ParseCacheHeader& header) {
+        struct stat st;
+        if (!enabled() || stat(path.c_str(), &st) != 0) return false;
+        memset(&header, 0, sizeof(header));
+        strcpy(header.magic, "TTCACH2");
+        header.inode = st.st_ino;
+        header.size = st.st_size;
+        header.mtimeSec = st.st_mtim.tv_sec;
+        header.mtimeNsec = st.st_mtim.tv_nsec;
+        header.hash = hashContent(content);
+        return true;
+    }
+    
+    // Write the cache of tasks parsed from the file header describes, unless
+    // path has changed since
+    static void save(const string& path, ParseCacheHeader header, const ChunkedVector<TaskTracker>& tasks) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !matches(header, st)) return;
+        
+        ScopedPhase phase(PHASE_WRITE);
+        string data;
+        for (const auto& task : tasks) {
+            if (task.isTaskDeleted()) continue;
+            int32_t id = task.getId();
+            uint32_t lengths[5] = { (uint32_t)task.desc.size(), (uint32_t)task.status.size(),
+                                    (uint32_t)task.createdAt.size(), (uint32_t)task.updatedAt.size(),
+                                    (uint32_t)task.extra.size() };
+            data.append((const char*)&id, 4);
+            data.append((const char*)lengths, 20);
+            data += task.desc;
+            data += task.status;
+            data += task.createdAt;
+            data += task.updatedAt;
+            data += task.extra;
+            header.count++;
+        }
+        
+        string tmp = cachePath(path) + ".tmp";
+        ofstream file(tmp, ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write(data.data(), data.size());
+        file.close();
+        if (file) rename(tmp.c_str(), cachePath(path).c_str());
+        timings.bytesWritten += sizeof(header) + data.size();
+    }
+    
+    static void remove(const string& path) {
+        unlink(cachePath(path).c_str());
+    }
+};
+
+// Sharded layout: a directory of shard files, each holding the tasks whose
+// ids fall in one fixed-size range, plus a small manifest:
+//   tasks.d/manifest           - shard size, next id and the list of shards
+//   tasks.d/shard-000001.json  - ids 10000..19999, same format as tasks.json
+// Files are written to a temporary name and renamed into place.
+class ShardStore {
+public:
+    string dir;
+    int shardSize = 10000;
+    int nextId = 1;
+    set<long> shards;
+    
+    static bool exists(const string& dir) {
+        struct stat st;
+        return stat((dir + "/manifest").c_str(), &st) == 0;
+    }
+    
+    long shardOf(int id) const {
+        return id / shardSize;
+    }
+    
+    string shardPath(long shard) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/shard-%06ld.json", shard);
+        return dir + name;
+    }
+    
+    bool loadManifest() {
+        ifstream file(dir + "/manifest");
+        if (!file.is_open()) return false;
+        
+        string key;
+        while (file >> key) {
+            if (key == "shard-size") file >> shardSize;
+            else if (key == "next-id") file >> nextId;
+            else if (key == "shards") {
+                string line;
+                getline(file, line);
+                istringstream list(line);
+                long shard;
+                while (list >> shard) shards.insert(shard);
+            }
+        }
+        return shardSize > 0;
+    }
+    
+    void saveManifest() const {
+        string tmp = dir + "/manifest.tmp";
+        {
+            ofstream file(tmp);
+            file << "shard-size " << shardSize << "\n";
+            file << "next-id " << nextId << "\n";
+            file << "shards";
+            for (long shard : shards) file << " " << shard;
+            file << "\n";
+        }
+        rename(tmp.c_str(), (dir + "/manifest").c_str());
+    }
+};
+
+// When path was created (its birth time, where the filesystem records one);
+// now if it does not exist yet, 0 if unknown
+time_t createdTime(const string& path) {
+    struct statx st;
+    if (statx(AT_FDCWD, path.c_str(), 0, STATX_BTIME, &st) != 0) return errno == ENOENT ? time(0) : 0;
+    return (st.stx_mask & STATX_BTIME) ? (time_t)st.stx_btime.tv_sec : 0;
+}
+
+// Cold tier for done tasks: immutable, time-partitioned segment files with
+// one compact JSON task per line, plus a manifest:
+//   tasks.archive/manifest      - last archival run, highest archived id, segments
+//   tasks.archive/2024-05.json  - tasks archived from May 2024 (by updatedAt)
+// A later run that archives more tasks from the same month writes a new
+// segment (2024-05.2.json) instead of touching the existing one. Segments
+// and manifest are synced before the hot tasks are saved; until that save is
+// synced too, the manifest lists the run's segments as pending, since the
+// hot file may still hold their tasks.
+class ArchiveStore {
+public:
+    struct Segment {
+        string name;
+        size_t count;
+    };
+    
+    string dir;
+    time_t lastRun = 0;
+    int maxId = 0;
+    vector<Segment> segments;
+    vector<string> pending;
+    
+    static bool exists(const string& dir) {
+        struct stat st;
+        return stat((dir + "/manifest").c_str(), &st) == 0;
+    }
+    
+    bool loadManifest() {
+        ifstream file(dir + "/manifest");
+        if (!file.is_open()) return false;
+        
+        string key;
+        while (file >> key) {
+            if (key == "last-run") file >> lastRun;
+            else if (key == "max-id") file >> maxId;
+            else if (key == "segment") {
+                Segment segment;
+                file >> segment.name >> segment.count;
+                segments.push_back(segment);
+            }
+            else if (key == "pending") {
+                string name;
+                file >> name;
+                pending.push_back(name);
+            }
+        }
+        return true;
+    }
+    
+    // Replace the manifest durably: the new one is synced before it takes
+    // the old one's name, and the directory after
+    void saveManifest() const {
+        string tmp = dir + "/manifest.tmp";
+        {
+            ofstream file(tmp);
+            file << "last-run " << lastRun << "\n";
+            file << "max-id " << maxId << "\n";
+            for (const auto& segment : segments) {
+                file << "segment " << segment.name << " " << segment.count << "\n";
+            }
+            for (const string& name : pending) file << "pending " << name << "\n";
+        }
+        syncFile(tmp);
+        rename(tmp.c_str(), (dir + "/manifest").c_str());
+        syncFile(dir);
+    }
+    
+    // Write and sync a new segment for one month ("2024-05") and register
+    // it as pending; saveManifest makes it part of the archive
+    void addSegment(const string& month, const vector<const TaskTracker*>& tasks) {
+        string name = month + ".json";
+        struct stat st;
+        for (int n = 2; stat((dir + "/" + name).c_str(), &st) == 0; n++) {
+            name = month + "." + to_string(n) + ".json";
+        }
+        
+        string content;
+        for (const TaskTracker* task : tasks) {
+            content += task->toCompactJson();
+            content += "\n";
+            maxId = max(maxId, task->getId());
+        }
+        {
+            ScopedPhase phase(PHASE_WRITE);
+            ofstream file(dir + "/" + name);
+            file.write(content.data(), content.size());
+            timings.bytesWritten += content.size();
+        }
+        syncFile(dir + "/" + name);
+        segments.push_back({name, tasks.size()});
+        pending.push_back(name);
+    }
+    
+    // Parse one segment file
+    template <typename F>
+    void forSegment(const string& name, F onTask) const {
+        string content;
+        {
+            ScopedPhase phase(PHASE_READ);
+            if (!readFile(dir + "/" + name, content)) return;
+            timings.bytesRead += content.size();
+        }
+        ScopedPhase phase(PHASE_PARSE);
+        parseTasks(content, onTask);
+    }
+    
+    // Parse every segment, oldest first
+    template <typename F>
+    void forEach(F onTask) const {
+        for (const auto& segment : segments) forSegment(segment.name, onTask);
+    }
+    
+    // Ids of the tasks in pending segments
+    unordered_set<int> pendingIds() const {
+        unordered_set<int> ids;
+        for (const string& name : pending) {
+            forSegment(name, [&](TaskTracker&& task) { ids.insert(task.getId()); });
+        }
+        return ids;
+    }
+};
+
+// A file mapped read-write into memory that can grow in place
+class MappedFile {
+private:
+    int fd = -1;
+    char* base = nullptr;
+    size_t length = 0;
+    
+public:
+    ~MappedFile() {
+        close();
+    }
+    
+    bool open(const string& path, bool create) {
+        fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+        if (fd < 0) return false;
+        struct stat st;
+        fstat(fd, &st);
+        return map((size_t)st.st_size);
+    }
+    
+    bool map(size_t size) {
+        if (base != nullptr) munmap(base, length);
+        base = nullptr;
+        length = size;
+        if (size == 0) return true;
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        base = (char*)p;
+        return true;
+    }
+    
+    // Grow the file to at least size bytes (doubling), then remap it.
+    // Pointers into the old mapping are invalid afterwards.
+    bool reserve(size_t size) {
+        if (size <= length) return true;
+        size_t grown = max(size, length * 2);
+        if (ftruncate(fd, (off_t)grown) != 0) return false;
+        return map(grown);
+    }
+    
+    void close() {
+        if (base != nullptr) munmap(base, length);
+        if (fd >= 0) ::close(fd);
+        base = nullptr;
+        length = 0;
+        fd = -1;
+    }
+    
+    char* data() const {
+        return base;
+    }
+    
+    size_t size() const {
+        return length;
+    }
+    
+    void sync() {
+        if (base != nullptr) msync(base, length, MS_SYNC);
+    }
+};
+
+// One task in the record file. Everything but the description has a fixed
+// width, so a status change or delete is a write into the task's own slot.
+struct TaskRecord {
+    int32_t id;
+    uint8_t deleted;
+    uint8_t reserved0[3];
+    char status[16];
+    char createdAt[24];         // ctime format, not NUL-terminated when full
+    char updatedAt[24];
+    uint64_t descOffset;        // description bytes in the heap file
+    uint32_t descLength;
+    uint32_t descCapacity;
+    uint32_t extraLength;       // optional fields, after the description
+    uint8_t reserved[36];
+};
+static_assert(sizeof(TaskRecord) == 128, "TaskRecord must stay 128 bytes");
+
+struct RecordFileHeader {
+    char magic[8];              // "TTREC01"
+    uint32_t recordSize;
+    uint32_t reserved0;
+    uint64_t count;
+    int64_t nextId;
+    uint8_t reserved[96];
+};
+static_assert(sizeof(RecordFileHeader) == sizeof(TaskRecord), "header fills one slot");
+
+struct HeapHeader {
+    char magic[8];              // "TTHEAP1"
+    uint64_t end;               // first never-used byte
+    uint64_t freeHead;          // first free block, 0 if none
+    uint8_t reserved[40];
+};
+
+// Header of a free heap block, stored in the block itself
+struct FreeBlock {
+    uint64_t next;
+    uint32_t capacity;
+};
+
+// Binary record layout: tasks.rec holds a header and fixed-width TaskRecord
+// slots sorted by id (ids only grow, so appends keep the order), and
+// tasks.heap holds descriptions. Both files are memory-mapped. Freed or
+// outgrown description blocks go on a free list and are reused first-fit.
+class RecordStore {
+private:
+    MappedFile records;
+    MappedFile heap;
+    
+    RecordFileHeader* header() const {
+        return (RecordFileHeader*)records.data();
+    }
+    
+    HeapHeader* heapHeader() const {
+        return (HeapHeader*)heap.data();
+    }
+    
+    static void setField(char* field, size_t width, const string& value) {
+        memset(field, 0, width);
+        memcpy(field, value.data(), min(width, value.size()));
+    }
+    
+    static string getField(const char* field, size_t width) {
+        return string(field, strnlen(field, width));
+    }
+    
+    static uint32_t roundCapacity(size_t length) {
+        return (uint32_t)max<size_t>(16, (length + 15) & ~(size_t)15);
+    }
+    
+    // Find room for capacity bytes: first fit from the free list (looking
+    // at a bounded number of blocks), else the end of the heap. A reused
+    // block may be larger than asked for; capacity is set to its real size
+    // so the whole block is freed again later.
+    uint64_t allocate(uint32_t& capacity) {
+        uint64_t* link = &heapHeader()->freeHead;
+        for (int i = 0; *link != 0 && i < 64; i++) {
+            FreeBlock* block = (FreeBlock*)(heap.data() + *link);
+            if (block->capacity >= capacity) {
+                uint64_t offset = *link;
+                *link = block->next;
+                capacity = block->capacity;
+                return offset;
+            }
+            link = &block->next;
+        }
+        
+        uint64_t offset = heapHeader()->end;
+        heap.reserve(offset + capacity);
+        heapHeader()->end = offset + capacity;
+        return offset;
+    }
+    
+    void release(uint64_t offset, uint32_t capacity) {
+        if (capacity == 0) return;
+        FreeBlock* block = (FreeBlock*)(heap.data() + offset);
+        block->next = heapHeader()->freeHead;
+        block->capacity = capacity;
+        heapHeader()->freeHead = offset;
+    }
+    
+    // The description and the optional fields share one heap block
+    void writeDescription(TaskRecord& rec, const string& desc, const string& extra) {
+        if (desc.size() + extra.size() > rec.descCapacity) {
+            release(rec.descOffset, rec.descCapacity);
+            uint32_t capacity = roundCapacity(desc.size() + extra.size());
+            uint64_t offset = allocate(capacity); // may remap the heap only
+            rec.descOffset = offset;
+            rec.descCapacity = capacity;
+        }
+        memcpy(heap.data() + rec.descOffset, desc.data(), desc.size());
+        memcpy(heap.data() + rec.descOffset + desc.size(), extra.data(), extra.size());
+        rec.descLength = (uint32_t)desc.size();
+        rec.extraLength = (uint32_t)extra.size();
+    }
+    
+public:
+    static bool exists(const string& base) {
+        struct stat st;
+        return stat((base + ".rec").c_str(), &st) == 0;
+    }
+    
+    bool open(const string& base) {
+        if (!records.open(base + ".rec", false) || !heap.open(base + ".heap", false)) return false;
+        return records.size() >= sizeof(RecordFileHeader) &&
+               memcmp(header()->magic, "TTREC01", 8) == 0 &&
+               header()->recordSize == sizeof(TaskRecord) &&
+               heap.size() >= sizeof(HeapHeader);
+    }
+    
+    bool create(const string& base) {
+        if (!records.open(base + ".rec", true) || !heap.open(base + ".heap", true)) return false;
+        records.reserve(sizeof(RecordFileHeader) + 1024 * sizeof(TaskRecord));
+        heap.reserve(64 * 1024);
+        memcpy(header()->magic, "TTREC01", 8);
+        header()->recordSize = sizeof(TaskRecord);
+        header()->count = 0;
+        header()->nextId = 1;
+        memcpy(heapHeader()->magic, "TTHEAP1", 8);
+        heapHeader()->end = sizeof(HeapHeader);
+        heapHeader()->freeHead = 0;
+        return true;
+    }
+    
+    void close() {
+        records.close();
+        heap.close();
+    }
+    
+    void sync() {
+        ScopedPhase phase(PHASE_WRITE);
+        heap.sync();
+        records.sync();
+    }
+    
+    size_t count() const {
+        return header()->count;
+    }
+    
+    int nextId() const {
+        return (int)header()->nextId;
+    }
+    
+    TaskRecord& at(size_t index) const {
+        return ((TaskRecord*)records.data())[index + 1];
+    }
+    
+    // Index of the record with this id (binary search), or -1
+    long find(int id) const {
+        size_t lo = 0, hi = count();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (at(mid).id < id) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo < count() && at(lo).id == id ? (long)lo : -1;
+    }
+    
+    TaskTracker read(size_t index) const {
+        const TaskRecord& rec = at(index);
+        TaskTracker task(rec.id,
+                         string(heap.data() + rec.descOffset, rec.descLength),
+                         getField(rec.status, sizeof(rec.status)),
+                         getField(rec.createdAt, sizeof(rec.createdAt)),
+                         getField(rec.updatedAt, sizeof(rec.updatedAt)));
+        task.extra.assign(heap.data() + rec.descOffset + rec.descLength, rec.extraLength);
+        if (rec.deleted) task.deleteTask();
+        return task;
+    }
+    
+    // Bring a record up to date with the task, touching only what changed:
+    // a status change is a write of the status and updatedAt fields
+    void write(size_t index, const TaskTracker& task) {
+        TaskRecord& rec = at(index);
+        if (task.isTaskDeleted()) {
+            if (!rec.deleted) remove(index);
+            return;
+        }
+        rec.deleted = 0;
+        if (getField(rec.status, sizeof(rec.status)) != task.status) {
+            setField(rec.status, sizeof(rec.status), task.status);
+        }
+        setField(rec.updatedAt, sizeof(rec.updatedAt), task.updatedAt);
+        if (rec.descLength != task.desc.size() || rec.extraLength != task.extra.size() ||
+            memcmp(heap.data() + rec.descOffset, task.desc.data(), task.desc.size()) != 0 ||
+            memcmp(heap.data() + rec.descOffset + rec.descLength, task.extra.data(), task.extra.size()) != 0) {
+            writeDescription(rec, task.desc, task.extra);
+        }
+    }
+    
+    // Add a task at its place in id order. New ids are the highest, so this
+    // is normally an append; anything else shifts the later records.
+    size_t insert(const TaskTracker& task) {
+        size_t index = count();
+        while (index > 0 && at(index - 1).id > task.getId()) index--;
+        records.reserve(sizeof(RecordFileHeader) + (count() + 1) * sizeof(TaskRecord));
+        if (index < count()) {
+            memmove(&at(index + 1), &at(index), (count() - index) * sizeof(TaskRecord));
+        }
+        TaskRecord& rec = at(index);
+        memset(&rec, 0, sizeof(rec));
+        rec.id = task.getId();
+        setField(rec.status, sizeof(rec.status), task.status);
+        setField(rec.createdAt, sizeof(rec.createdAt), task.createdAt);
+        setField(rec.updatedAt, sizeof(rec.updatedAt), task.updatedAt);
+        writeDescription(rec, task.desc, task.extra);
+        header()->count++;
+        header()->nextId = max<int64_t>(header()->nextId, task.getId() + 1);
+        return index;
+    }
+    
+    void remove(size_t index) {
+        TaskRecord& rec = at(index);
+        rec.deleted = 1;
+        release(rec.descOffset, rec.descCapacity);
+        rec.descOffset = 0;
+        rec.descLength = 0;
+        rec.descCapacity = 0;
+        rec.extraLength = 0;
+    }
+};
+
+// Page file for the B+tree engine: 4 KiB pages, page 0 is the header
+const uint32_t BTREE_PAGE_SIZE = 4096;
+const size_t BTREE_CACHE_PAGES = 1024;      // buffer pool size (4 MiB)
+const size_t BTREE_MAX_INLINE = 1000;       // larger task payloads overflow
+
+struct BTreeHeader {
+    char magic[8];              // "TTBTRE1"
+    uint32_t pageSize;
+    uint32_t root;
+    uint32_t pageCount;
+    uint32_t freeHead;          // first free page, 0 if none
+    uint64_t count;             // live tasks
+    int64_t nextId;
+};
+
+enum BTreeNodeType : uint8_t { BTREE_LEAF = 1, BTREE_INTERNAL = 2 };
+
+// Start of every node page. Internal nodes follow it with child[0] and
+// (key, child) pairs; leaves with a slot array of cell offsets, the cells
+// themselves packed at the end of the page.
+struct BTreeNode {
+    uint8_t type;
+    uint8_t reserved0;
+    uint16_t count;             // keys (internal) or cells (leaf)
+    uint32_t next;              // leaf: right sibling, 0 for the last leaf
+    uint8_t reserved[8];
+};
+static_assert(sizeof(BTreeNode) == 16, "BTreeNode must stay 16 bytes");
+
+// Fixed-size cache of file pages with clock (second-chance) eviction, with
+// a redo log next to the file (tasks.btree.wal) so a commit is atomic. A
+// dirty page is never written to the file before its commit: evicting it
+// appends it to the log, and a later fetch reads it back from there. Commit
+// logs the remaining dirty pages plus a checksummed commit record, fdatasyncs
+// the log, copies the pages into the file (the header page last), fdatasyncs
+// the file and empties the log. Opening the file replays a log that ends in
+// a valid commit record and drops one that does not, so a crash at any point
+// leaves the last committed tree. A page pointer is only valid until the
+// next fetch.
+class BufferPool {
+private:
+    int fd = -1;
+    int walFd = -1;
+    size_t capacity;
+    vector<char> frames;
+    vector<uint32_t> pageOf;
+    vector<uint8_t> dirty;
+    vector<uint8_t> referenced;
+    unordered_map<uint32_t, size_t> table;      // page -> frame
+    size_t used = 0;
+    size_t hand = 0;
+    unordered_map<uint32_t, off_t> logged;      // page -> its latest copy in the log
+    off_t walEnd = 0;
+    uint64_t walSum = 0;                        // checksum of the log so far
+    
+    // Log records are a page number and a spare word, then the page; the
+    // commit record has page COMMIT and the checksum in place of the page
+    static const uint32_t COMMIT = 0xffffffff;
+    static const size_t RECORD = 8 + BTREE_PAGE_SIZE;
+    
+    // FNV-1a over the page bytes, chained across the records
+    static uint64_t checksum(uint64_t sum, const char* data, size_t size) {
+        if (sum == 0) sum = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            sum = (sum ^ (unsigned char)data[i]) * 1099511628211ull;
+        }
+        return sum;
+    }
+    
+    void logPage(size_t frame) {
+        ScopedPhase phase(PHASE_WRITE);
+        char record[8] = {};
+        memcpy(record, &pageOf[frame], 4);
+        const char* data = &frames[frame * BTREE_PAGE_SIZE];
+        struct iovec parts[2] = { { record, 8 }, { (void*)data, BTREE_PAGE_SIZE } };
+        ssize_t written = pwritev(walFd, parts, 2, walEnd);
+        if (written > 0) timings.bytesWritten += written;
+        walSum = checksum(walSum, record, 8);
+        walSum = checksum(walSum, data, BTREE_PAGE_SIZE);
+        logged[pageOf[frame]] = walEnd + 8;
+        walEnd += RECORD;
+        dirty[frame] = 0;
+    }
+    
+    size_t victim() {
+        if (used < capacity) {
+            frames.resize((used + 1) * BTREE_PAGE_SIZE);
+            return used++;
+        }
+        while (referenced[hand]) {
+            referenced[hand] = 0;
+            hand = (hand + 1) % capacity;
+        }
+        size_t frame = hand;
+        hand = (hand + 1) % capacity;
+        if (dirty[frame]) logPage(frame);
+        table.erase(pageOf[frame]);
+        return frame;
+    }
+    
+    // Copy the logged pages into the file, the header page last, and empty
+    // the log once they are on stable storage
+    void checkpoint() {
+        ScopedPhase phase(PHASE_WRITE);
+        vector<pair<uint32_t, off_t>> pages(logged.begin(), logged.end());
+        sort(pages.begin(), pages.end());
+        if (!pages.empty() && pages.front().first == 0) rotate(pages.begin(), pages.begin() + 1, pages.end());
+        vector<char> page(BTREE_PAGE_SIZE);
+        for (const auto& entry : pages) {
+            if (pread(walFd, page.data(), BTREE_PAGE_SIZE, entry.second) != (ssize_t)BTREE_PAGE_SIZE) continue;
+            ssize_t written = pwrite(fd, page.data(), BTREE_PAGE_SIZE, (off_t)entry.first * BTREE_PAGE_SIZE);
+            if (written > 0) timings.bytesWritten += written;
+        }
+        fdatasync(fd);
+        if (ftruncate(walFd, 0) == 0) fdatasync(walFd);
+        logged.clear();
+        walEnd = 0;
+        walSum = 0;
+    }
+    
+    // Replay a log left by a commit that did not finish its checkpoint;
+    // anything after the last valid commit record is dropped
+    void recover() {
+        struct stat st;
+        if (fstat(walFd, &st) != 0) return;
+        vector<char> record(RECORD);
+        uint64_t sum = 0;
+        bool committed = false;
+        unordered_map<uint32_t, off_t> pages;
+        for (off_t pos = 0; pos + (off_t)RECORD <= st.st_size; pos += RECORD) {
+            if (pread(walFd, record.data(), RECORD, pos) != (ssize_t)RECORD) break;
+            uint32_t page;
+            memcpy(&page, record.data(), 4);
+            if (page == COMMIT) {
+                uint64_t stored;
+                memcpy(&stored, record.data() + 8, 8);
+                if (stored != sum) break;
+                committed = true;
+                logged = pages;
+                continue;
+            }
+            sum = checksum(sum, record.data(), RECORD);
+            pages[page] = pos + 8;
+        }
+        if (committed) checkpoint();
+        else if (st.st_size > 0 && ftruncate(walFd, 0) == 0) fdatasync(walFd);
+        logged.clear();
+    }
+    
+public:
+    explicit BufferPool(size_t pages) :
+        capacity(pages), pageOf(pages), dirty(pages), referenced(pages) {}
+    
+    ~BufferPool() {
+        close();
+    }
+    
+    bool open(const string& path, bool create) {
+        fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+        if (fd < 0) return false;
+        walFd = ::open((path + ".wal").c_str(), O_RDWR | O_CREAT | (create ? O_TRUNC : 0), 0644);
+        if (walFd < 0) return false;
+        if (!create) recover();
+        return true;
+    }
+    
+    // The page's bytes, read in on a miss (from the log if it was evicted
+    // since the last commit); pages past the end read as zeros. forWrite
+    // marks the page dirty.
+    char* fetch(uint32_t page, bool forWrite = false) {
+        size_t frame;
+        auto it = table.find(page);
+        if (it != table.end()) {
+            frame = it->second;
+        }
+        else {
+            frame = victim();
+            char* data = &frames[frame * BTREE_PAGE_SIZE];
+            ScopedPhase phase(PHASE_READ);
+            auto copy = logged.find(page);
+            ssize_t got = copy != logged.end() ? pread(walFd, data, BTREE_PAGE_SIZE, copy->second)
+                                               : pread(fd, data, BTREE_PAGE_SIZE, (off_t)page * BTREE_PAGE_SIZE);
+            if (got < 0) got = 0;
+            memset(data + got, 0, BTREE_PAGE_SIZE - got);
+            timings.bytesRead += got;
+            pageOf[frame] = page;
+            table[page] = frame;
+        }
+        referenced[frame] = 1;
+        if (forWrite) dirty[frame] = 1;
+        return &frames[frame * BTREE_PAGE_SIZE];
+    }
+    
+    // Make every change since the last commit durable, all or nothing
+    void commit() {
+        for (size_t frame = 0; frame < used; frame++) {
+            if (dirty[frame]) logPage(frame);
+        }
+        if (logged.empty()) return;
+        
+        ScopedPhase phase(PHASE_WRITE);
+        vector<char> record(RECORD, 0);
+        uint32_t marker = COMMIT;
+        memcpy(record.data(), &marker, 4);
+        memcpy(record.data() + 8, &walSum, 8);
+        ssize_t written = pwrite(walFd, record.data(), RECORD, walEnd);
+        if (written > 0) timings.bytesWritten += written;
+        walEnd += RECORD;
+        fdatasync(walFd);
+        checkpoint();
+    }
+    
+    // Flush written pages to stable storage
+    void sync() {
+        ScopedPhase phase(PHASE_WRITE);
+        if (fd >= 0) fdatasync(fd);
+    }
+    
+    // Close the files, dropping changes not committed yet (a log without a
+    // commit record is discarded on the next open)
+    void close() {
+        if (fd >= 0) ::close(fd);
+        if (walFd >= 0) ::close(walFd);
+        fd = walFd = -1;
+        table.clear();
+        logged.clear();
+        used = 0;
+        hand = 0;
+        walEnd = 0;
+        walSum = 0;
+    }
+};
+
+// B+tree keyed by task id in tasks.btree. Internal nodes route by id; leaves
+// hold whole tasks and are chained in id order, so a scan walks the leaf
+// level. Every page goes through the buffer pool, so get, upsert and remove
+// touch O(log N) pages and memory does not grow with the tracker. Leaves
+// that empty out are unlinked from the chain and their parent and go on the
+// free list; partly empty leaves are not merged.
+class BTreeStore {
+private:
+    BufferPool pool{BTREE_CACHE_PAGES};
+    BTreeHeader head;
+    
+    // Internal nodes hold child[0] plus up to this many (key, child) pairs
+    static const size_t INTERNAL_MAX = (BTREE_PAGE_SIZE - sizeof(BTreeNode) - 4) / 8;
+    
+    // A decoded leaf. A cell is a flag byte (0 inline, 1 overflow) followed
+    // by the encoded task, or by the first overflow page and payload length.
+    struct Leaf {
+        uint32_t next = 0;
+        vector<int> ids;
+        vector<string> cells;
+        
+        size_t bytes() const {
+            size_t total = sizeof(BTreeNode);
+            for (const auto& cell : cells) total += 2 + 6 + cell.size();
+            return total;
+        }
+    };
+    
+    struct Internal {
+        vector<int> keys;
+        vector<uint32_t> children;      // keys.size() + 1
+    };
+    
+    uint8_t nodeType(uint32_t page) {
+        return ((BTreeNode*)pool.fetch(page))->type;
+    }
+    
+    Leaf readLeaf(uint32_t page) {
+        const char* data = pool.fetch(page);
+        const BTreeNode* node = (const BTreeNode*)data;
+        const uint16_t* slots = (const uint16_t*)(data + sizeof(BTreeNode));
+        Leaf leaf;
+        leaf.next = node->next;
+        for (uint16_t i = 0; i < node->count; i++) {
+            const char* cell = data + slots[i];
+            int32_t id;
+            uint16_t size;
+            memcpy(&id, cell, 4);
+            memcpy(&size, cell + 4, 2);
+            leaf.ids.push_back(id);
+            leaf.cells.emplace_back(cell + 6, size);
+        }
+        return leaf;
+    }
+    
+    void writeLeaf(uint32_t page, const Leaf& leaf) {
+        char* data = pool.fetch(page, true);
+        memset(data, 0, BTREE_PAGE_SIZE);
+        BTreeNode* node = (BTreeNode*)data;
+        node->type = BTREE_LEAF;
+        node->count = (uint16_t)leaf.ids.size();
+        node->next = leaf.next;
+        uint16_t* slots = (uint16_t*)(data + sizeof(BTreeNode));
+        size_t end = BTREE_PAGE_SIZE;
+        for (size_t i = 0; i < leaf.ids.size(); i++) {
+            uint16_t size = (uint16_t)leaf.cells[i].size();
+            end -= 6 + size;
+            memcpy(data + end, &leaf.ids[i], 4);
+            memcpy(data + end + 4, &size, 2);
+            memcpy(data + end + 6, leaf.cells[i].data(), size);
+            slots[i] = (uint16_t)end;
+        }
+    }
+    
+    Internal readInternal(uint32_t page) {
+        const char* data = pool.fetch(page);
+        const BTreeNode* node = (const BTreeNode*)data;
+        const char* p = data + sizeof(BTreeNode);
+        Internal internal;
+        internal.keys.resize(node->count);
+        internal.children.resize(node->count + 1);
+        memcpy(&internal.children[0], p, 4);
+        for (uint16_t i = 0; i < node->count; i++) {
+            memcpy(&internal.keys[i], p + 4 + i * 8, 4);
+            memcpy(&internal.children[i + 1], p + 8 + i * 8, 4);
+        }
+        return internal;
+    }
+    
+    void writeInternal(uint32_t page, const Internal& internal) {
+        char* data = pool.fetch(page, true);
+        memset(data, 0, BTREE_PAGE_SIZE);
+        BTreeNode* node = (BTreeNode*)data;
+        node->type = BTREE_INTERNAL;
+        node->count = (uint16_t)internal.keys.size();
+        char* p = data + sizeof(BTreeNode);
+        memcpy(p, &internal.children[0], 4);
+        for (size_t i = 0; i < internal.keys.size(); i++) {
+            memcpy(p + 4 + i * 8, &internal.keys[i], 4);
+            memcpy(p + 8 + i * 8, &internal.children[i + 1], 4);
+        }
+    }
+    
+    uint32_t allocatePage() {
+        if (head.freeHead != 0) {
+            uint32_t page = head.freeHead;
+            memcpy(&head.freeHead, pool.fetch(page), 4);
+            return page;
+        }
+        return head.pageCount++;
+    }
+    
+    void freePage(uint32_t page) {
+        char* data = pool.fetch(page, true);
+        memset(data, 0, BTREE_PAGE_SIZE);
+        memcpy(data, &head.freeHead, 4);
+        head.freeHead = page;
+    }
+    
+    // Overflow pages: next page (0 at the end), then payload bytes
+    static const size_t OVERFLOW_DATA = BTREE_PAGE_SIZE - 4;
+    
+    string makeCell(const string& payload) {
+        if (payload.size() <= BTREE_MAX_INLINE) return '\0' + payload;
+        
+        uint32_t first = 0, previous = 0;
+        for (size_t offset = 0; offset < payload.size(); offset += OVERFLOW_DATA) {
+            uint32_t page = allocatePage();
+            if (previous != 0) memcpy(pool.fetch(previous, true), &page, 4);
+            else first = page;
+            char* data = pool.fetch(page, true);
+            memset(data, 0, BTREE_PAGE_SIZE);
+            memcpy(data + 4, payload.data() + offset, min(OVERFLOW_DATA, payload.size() - offset));
+            previous = page;
+        }
+        string cell(9, '\1');
+        uint32_t length = (uint32_t)payload.size();
+        memcpy(&cell[1], &first, 4);
+        memcpy(&cell[5], &length, 4);
+        return cell;
+    }
+    
+    string cellPayload(const string& cell) {
+        if (cell[0] == '\0') return cell.substr(1);
+        
+        uint32_t page, length;
+        memcpy(&page, &cell[1], 4);
+        memcpy(&length, &cell[5], 4);
+        string payload;
+        payload.reserve(length);
+        while (payload.size() < length) {
+            const char* data = pool.fetch(page);
+            payload.append(data + 4, min<size_t>(OVERFLOW_DATA, length - payload.size()));
+            memcpy(&page, data, 4);
+        }
+        return payload;
+    }
+    
+    void freeCell(const string& cell) {
+        if (cell[0] == '\0') return;
+        uint32_t page;
+        memcpy(&page, &cell[1], 4);
+        while (page != 0) {
+            uint32_t next;
+            memcpy(&next, pool.fetch(page), 4);
+            freePage(page);
+            page = next;
+        }
+    }
+    
+    // Status, createdAt and updatedAt with a length byte each, then the
+    // description, then (after a NUL) the optional fields if any
+    static string encode(const TaskTracker& task) {
+        string payload;
+        for (const string* field : { &task.status, &task.createdAt, &task.updatedAt }) {
+            payload += (char)min<size_t>(field->size(), 255);
+            payload.append(*field, 0, 255);
+        }
+        payload += task.desc;
+        if (!task.extra.empty()) payload += '\0' + task.extra;
+        return payload;
+    }
+    
+    static TaskTracker decode(int id, const string& payload) {
+        string fields[3];
+        size_t pos = 0;
+        for (string& field : fields) {
+            size_t length = (unsigned char)payload[pos];
+            field = payload.substr(pos + 1, length);
+            pos += 1 + length;
+        }
+        size_t descEnd = payload.find('\0', pos);
+        TaskTracker task(id, payload.substr(pos, descEnd - pos), fields[0], fields[1], fields[2]);
+        if (descEnd != string::npos) task.extra = payload.substr(descEnd + 1);
+        return task;
+    }
+    
+    // Walk from the root to the leaf that holds id, recording the internal
+    // pages passed on the way and which child was taken in each
+    uint32_t descend(int id, vector<uint32_t>* path = nullptr, vector<size_t>* branches = nullptr) {
+        uint32_t page = head.root;
+        while (nodeType(page) == BTREE_INTERNAL) {
+            if (path != nullptr) path->push_back(page);
+            Internal internal = readInternal(page);
+            size_t i = upper_bound(internal.keys.begin(), internal.keys.end(), id) - internal.keys.begin();
+            if (branches != nullptr) branches->push_back(i);
+            page = internal.children[i];
+        }
+        return page;
+    }
+    
+    // Link a new right sibling into the parent, splitting upward as needed
+    void insertIntoParent(vector<uint32_t>& path, int key, uint32_t right) {
+        if (path.empty()) {
+            Internal root;
+            root.keys.push_back(key);
+            root.children = { head.root, right };
+            head.root = allocatePage();
+            writeInternal(head.root, root);
+            return;
+        }
+        
+        uint32_t page = path.back();
+        path.pop_back();
+        Internal node = readInternal(page);
+        size_t i = upper_bound(node.keys.begin(), node.keys.end(), key) - node.keys.begin();
+        node.keys.insert(node.keys.begin() + i, key);
+        node.children.insert(node.children.begin() + i + 1, right);
+        if (node.keys.size() <= INTERNAL_MAX) {
+            writeInternal(page, node);
+            return;
+        }
+        
+        // Ids are handed out in increasing order, so a split at the right
+        // edge keeps the left node full instead of leaving two half-empty
+        size_t mid = i == node.keys.size() - 1 ? node.keys.size() - 2 : node.keys.size() / 2;
+        Internal sibling;
+        sibling.keys.assign(node.keys.begin() + mid + 1, node.keys.end());
+        sibling.children.assign(node.children.begin() + mid + 1, node.children.end());
+        int promoted = node.keys[mid];
+        node.keys.resize(mid);
+        node.children.resize(mid + 1);
+        uint32_t siblingPage = allocatePage();
+        writeInternal(page, node);
+        writeInternal(siblingPage, sibling);
+        insertIntoParent(path, promoted, siblingPage);
+    }
+    
+    // Write a leaf back, splitting it when its cells no longer fit
+    void storeLeaf(uint32_t page, Leaf& leaf, size_t inserted, vector<uint32_t>& path) {
+        if (leaf.bytes() <= BTREE_PAGE_SIZE) {
+            writeLeaf(page, leaf);
+            return;
+        }
+        
+        size_t split = leaf.ids.size() - 1;
+        if (inserted != leaf.ids.size() - 1 || leaf.next != 0) {
+            // Split by bytes, so both halves fit
+            size_t half = 0, target = (leaf.bytes() - sizeof(BTreeNode)) / 2;
+            for (split = 0; split < leaf.ids.size() - 1; split++) {
+                half += 8 + leaf.cells[split].size();
+                if (half >= target) break;
+            }
+            split = max<size_t>(split, 1);
+        }
+        Leaf sibling;
+        sibling.ids.assign(leaf.ids.begin() + split, leaf.ids.end());
+        sibling.cells.assign(leaf.cells.begin() + split, leaf.cells.end());
+        sibling.next = leaf.next;
+        leaf.ids.resize(split);
+        leaf.cells.resize(split);
+        uint32_t siblingPage = allocatePage();
+        leaf.next = siblingPage;
+        writeLeaf(page, leaf);
+        writeLeaf(siblingPage, sibling);
+        insertIntoParent(path, sibling.ids[0], siblingPage);
+    }
+    
+    // Take an emptied leaf out of the tree: point its left neighbour past
+    // it, remove it from its parent (and parents left without children from
+    // theirs) and free the pages. path and branches come from descend.
+    void dropLeaf(uint32_t page, uint32_t next, vector<uint32_t>& path, vector<size_t>& branches) {
+        // The left neighbour is the leaf holding the ids just below the
+        // nearest separator on the left; the first leaf has none
+        for (size_t level = path.size(); level-- > 0;) {
+            if (branches[level] == 0) continue;
+            int bound = readInternal(path[level]).keys[branches[level] - 1];
+            uint32_t left = descend(bound - 1);
+            Leaf neighbour = readLeaf(left);
+            neighbour.next = next;
+            writeLeaf(left, neighbour);
+            break;
+        }
+        freePage(page);
+        
+        while (!path.empty()) {
+            uint32_t parent = path.back();
+            size_t i = branches.back();
+            path.pop_back();
+            branches.pop_back();
+            Internal node = readInternal(parent);
+            node.children.erase(node.children.begin() + i);
+            if (!node.keys.empty()) node.keys.erase(node.keys.begin() + (i > 0 ? i - 1 : 0));
+            if (!node.children.empty()) {
+                writeInternal(parent, node);
+                break;
+            }
+            freePage(parent);
+            if (path.empty()) {
+                head.root = allocatePage();
+                writeLeaf(head.root, Leaf());
+            }
+        }
+        
+        // A root left with a single child hands the root over to it
+        while (nodeType(head.root) == BTREE_INTERNAL) {
+            Internal root = readInternal(head.root);
+            if (!root.keys.empty()) break;
+            freePage(head.root);
+            head.root = root.children[0];
+        }
+    }
+    
+    void writeHeader() {
+        memcpy(pool.fetch(0, true), &head, sizeof(head));
+    }
+    
+public:
+    static bool exists(const string& base) {
+        struct stat st;
+        return stat((base + ".btree").c_str(), &st) == 0;
+    }
+    
+    bool open(const string& base) {
+        if (!pool.open(base + ".btree", false)) return false;
+        memcpy(&head, pool.fetch(0), sizeof(head));
+        return strcmp(head.magic, "TTBTRE1") == 0 && head.pageSize == BTREE_PAGE_SIZE;
+    }
+    
+    bool create(const string& base) {
+        if (!pool.open(base + ".btree", true)) return false;
+        memset(&head, 0, sizeof(head));
+        strcpy(head.magic, "TTBTRE1");
+        head.pageSize = BTREE_PAGE_SIZE;
+        head.root = 1;
+        head.pageCount = 2;
+        head.nextId = 1;
+        writeLeaf(head.root, Leaf());
+        commit();
+        return true;
+    }
+    
+    void close() {
+        pool.close();
+    }
+    
+    int nextId() const {
+        return (int)head.nextId;
+    }
+    
+    bool get(int id, TaskTracker& out) {
+        Leaf leaf = readLeaf(descend(id));
+        auto it = lower_bound(leaf.ids.begin(), leaf.ids.end(), id);
+        if (it == leaf.ids.end() || *it != id) return false;
+        out = decode(id, cellPayload(leaf.cells[it - leaf.ids.begin()]));
+        return true;
+    }
+    
+    void upsert(const TaskTracker& task) {
+        vector<uint32_t> path;
+        uint32_t page = descend(task.getId(), &path);
+        Leaf leaf = readLeaf(page);
+        size_t i = lower_bound(leaf.ids.begin(), leaf.ids.end(), task.getId()) - leaf.ids.begin();
+        string cell = makeCell(encode(task));
+        if (i < leaf.ids.size() && leaf.ids[i] == task.getId()) {
+            freeCell(leaf.cells[i]);
+            leaf.cells[i] = move(cell);
+        }
+        else {
+            leaf.ids.insert(leaf.ids.begin() + i, task.getId());
+            leaf.cells.insert(leaf.cells.begin() + i, move(cell));
+            head.count++;
+        }
+        head.nextId = max<int64_t>(head.nextId, task.getId() + 1);
+        storeLeaf(page, leaf, i, path);
+    }
+    
+    bool remove(int id) {
+        vector<uint32_t> path;
+        vector<size_t> branches;
+        uint32_t page = descend(id, &path, &branches);
+        Leaf leaf = readLeaf(page);
+        auto it = lower_bound(leaf.ids.begin(), leaf.ids.end(), id);
+        if (it == leaf.ids.end() || *it != id) return false;
+        size_t i = it - leaf.ids.begin();
+        freeCell(leaf.cells[i]);
+        leaf.ids.erase(leaf.ids.begin() + i);
+        leaf.cells.erase(leaf.cells.begin() + i);
+        head.count--;
+        if (leaf.ids.empty() && !path.empty()) dropLeaf(page, leaf.next, path, branches);
+        else writeLeaf(page, leaf);
+        return true;
+    }
+    
+    // Visit every task in id order, one leaf in memory at a time, until
+    // visit returns false
+    template <typename F>
+    void scan(F visit) {
+        uint32_t page = descend(numeric_limits<int>::min());
+        while (page != 0) {
+            Leaf leaf = readLeaf(page);
+            for (size_t i = 0; i < leaf.ids.size(); i++) {
+                if (!visit(decode(leaf.ids[i], cellPayload(leaf.cells[i])))) return;
+            }
+            page = leaf.next;
+        }
+    }
+    
+    // Write the header and every dirty page, atomically (see BufferPool)
+    void commit() {
+        writeHeader();
+        pool.commit();
+    }
+    
+    void sync() {
+        pool.sync();
+    }
+};
+
+// "tasks.json" -> "tasks"
+string baseName(const string& file) {
+    size_t dot = file.rfind('.');
+    size_t slash = file.rfind('/');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) return file;
+    return file.substr(0, dot);
+}
+
+// Read "key = value" lines from a config file; '#' starts a comment
+map<string, string> readConfig(const string& path) {
+    map<string, string> config;
+    ifstream file(path);
+    string line;
+    while (getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t eq = line.find('=');
+        if (eq == string::npos) continue;
+        auto trim = [](string str) {
+            size_t first = str.find_first_not_of(" \t\r");
+            size_t last = str.find_last_not_of(" \t\r");
+            return first == string::npos ? string() : str.substr(first, last - first + 1);
+        };
+        config[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+    }
+    return config;
+}
+
+void writeConfig(const string& path, const map<string, string>& config) {
+    ofstream file(path);
+    for (const auto& entry : config) {
+        file << entry.first << " = " << entry.second << "\n";
+    }
+}
+
+typedef function<bool(const TaskTracker&)> TaskPredicate;
+typedef function<void(const TaskTracker&)> TaskVisitor;
+typedef function<bool(string_view)> StatusFilter;
+
+// Persistence behind TaskManager. An engine owns the stored tasks: it may
+// keep them all in memory (JSON files), load parts on demand (shards) or
+// read them straight from disk (records). Changes are durable after commit.
+class StorageEngine {
+public:
+    virtual ~StorageEngine() {}
+    
+    // Engine name as used in tasks.conf
+    virtual string name() const = 0;
+    
+    // File or directory holding the tasks
+    virtual string location() const = 0;
+    
+    // One past the highest id stored
+    virtual int nextId() = 0;
+    
+    // Copy the live task with this id into out; false if there is none
+    virtual bool get(int id, TaskTracker& out) = 0;
+    
+    // Insert a task, or replace the live task with the same id
+    virtual void upsert(const TaskTracker& task) = 0;
+    
+    // Remove a live task; false if there is none with this id
+    virtual bool remove(int id) = 0;
+    
+    // Visit every live task that passes pred (every task if pred is empty)
+    virtual void scan(const TaskPredicate& pred, const TaskVisitor& visit) = 0;
+    
+    // Visit live tasks with the given status. Engines that can read a
+    // task's status without decoding the rest of it override this.
+    virtual void scanStatus(const string& status, const TaskVisitor& visit) {
+        scan([&](const TaskTracker& task) { return task.status == status; }, visit);
+    }
+    
+    // Visit live tasks whose status passes wanted in id order, until visit
+    // returns false; engines stop reading there. Every engine keeps tasks in
+    // the order they were added and new ids are always the highest, so
+    // storage order is id order. Engines that can read a task's status
+    // without decoding the rest of it skip unwanted tasks undecoded.
+    virtual void scanUntil(const StatusFilter& wanted, const TaskPredicate& visit) = 0;
+    
+    // Add the number of live tasks per status to counts
+    virtual void countByStatus(map<string, size_t>& counts) {
+        scan(nullptr, [&](const TaskTracker& task) { counts[task.status]++; });
+    }
+    
+    // Write every change since the last commit to the files
+    virtual void commit() = 0;
+    
+    // Flush what commit wrote to stable storage (fsync)
+    virtual void sync() = 0;
+    
+    // Delete the engine's files once its tasks have moved to another engine
+    virtual void destroy() = 0;
+};
+
+// tasks.json as the legacy pretty-printed array or as NDJSON, detected from
+// the file. Nothing is parsed up front. Point operations find the one task
+// by its "id" key in the raw file and record changes as edits, which commit
+// splices into the file text. Status listings and counts stream the file,
+// looking at each task's status before decoding the rest, and so do full
+// scans of files too large to load. Anything else needing every task loads
+// the whole file (from its parse cache when unchanged), after which
+// commit rewrites the file, except that in NDJSON mode tasks added since the
+// last commit are appended as single lines when nothing else changed.
+// Preferring NDJSON converts an array file on its next commit; an NDJSON
+// file stays NDJSON.
+class JsonFileEngine : public StorageEngine {
+private:
+    string path;
+    bool ndjson;
+    bool fileIsNdjson = false;
+    
+    // Raw mode, before everything is loaded: the file text plus edits
+    struct RawEdit {
+        size_t start, end;              // the task's object in content
+        bool removed;
+        TaskTracker task{0};
+    };
+    bool haveContent = false;
+    string content;
+    map<int, RawEdit> edits;            // changed or removed existing tasks
+    map<int, TaskTracker> added;        // new tasks
+    int rawMaxId = -1;                  // -1 until computed
+    int foundId = 0;                    // last findObject result, as a
+    pair<size_t, size_t> foundRange;    // point op looks a task up twice
+    
+    // Set when the parse cache missed on load; the cache is written when
+    // the engine closes, only if no task was changed in between (a command
+    // that writes would make it stale at once)
+    bool cacheWanted = false;
+    ParseCacheHeader cacheHeader;
+    
+    // Loaded mode
+    bool loaded = false;
+    bool dirty = false;                 // existing tasks changed or removed
+    ChunkedVector<TaskTracker> tasks;
+    unordered_map<int, size_t> slots;   // live id -> slot
+    vector<size_t> appended;            // slots added since the last commit
+    int maxId = 0;
+    
+    void readContent() {
+        if (haveContent) return;
+        haveContent = true;
+        ScopedPhase phase(PHASE_READ);
+        if (readFile(path, content)) timings.bytesRead += content.size();
+    }
+    
+    // Position of needle in text at or after from; memmem is much faster
+    // than string::find for keys starting with the ubiquitous '"'
+    static size_t findKey(string_view text, const char* needle, size_t length, size_t from) {
+        if (from >= text.size()) return string::npos;
+        const void* hit = memmem(text.data() + from, text.size() - from, needle, length);
+        return hit == nullptr ? string::npos : (const char*)hit - text.data();
+    }
+    
+    // The byte range of the task object whose "id" key is at idPos, leading
+    // indentation included; npos if the object is cut off
+    static pair<size_t, size_t> objectAt(string_view text, size_t idPos) {
+        size_t start = text.rfind('{', idPos);
+        size_t updated = findKey(text, "\"updatedAt\": \"", 14, idPos);
+        size_t close = updated == string::npos ? updated : text.find('"', updated + 14);
+        // Skip the optional fields, whose values may hold '}' or quotes
+        while (close != string::npos && close + 1 < text.size() && text[close + 1] == ',') {
+            close = readField(text, text.find('"', close + 1), nullptr, nullptr);
+        }
+        size_t end = close == string::npos ? close : text.find('}', close);
+        if (start == string::npos || end == string::npos) return { string::npos, string::npos };
+        while (start > 0 && text[start - 1] == ' ') start--;
+        return { start, end + 1 };
+    }
+    
+    // Call visit(object, status) for every complete task object in text from
+    // pos on until it returns false; returns where the first incomplete
+    // object (if any) starts, or npos if visit stopped
+    template <typename F>
+    static size_t forEachObject(string_view text, size_t pos, F visit) {
+        size_t done = pos;
+        while ((pos = findKey(text, "\"id\":", 5, pos)) != string::npos) {
+            pair<size_t, size_t> range = objectAt(text, pos);
+            size_t status = findKey(text, "\"status\": \"", 11, pos);
+            if (range.second == string::npos || status == string::npos || status > range.second) {
+                return text.rfind('{', pos) == string::npos ? pos : text.rfind('{', pos);
+            }
+            status += 11;
+            if (!visit(text.substr(range.first, range.second - range.first),
+                       text.substr(status, text.find('"', status) - status))) return string::npos;
+            pos = done = range.second;
+        }
+        // The text may end inside the next object's "id" key
+        size_t next = text.find('{', done);
+        return next == string::npos ? text.size() : next;
+    }
+    
+    // Find the object of the task with this id in content
+    pair<size_t, size_t> findObject(int id) {
+        if (foundId == id && id != 0) return foundRange;
+        readContent();
+        string key = "\"id\": " + to_string(id) + ",";
+        size_t hit = findKey(content, key.data(), key.size(), 0);
+        foundId = id;
+        foundRange = { string::npos, string::npos };
+        if (hit != string::npos) foundRange = objectAt(content, hit);
+        return foundRange;
+    }
+    
+    static TaskTracker parseObject(string_view object) {
+        TaskTracker task(0);
+        parseTasks(object, [&](TaskTracker&& parsed) { task = move(parsed); });
+        timings.tasksLoaded++;
+        return task;
+    }
+    
+    // Call visit(object, status) for every task without loading the file,
+    // until it returns false: over content if it was read already, otherwise
+    // by streaming the file in 1 MiB blocks, so memory stays constant however
+    // large the file is
+    template <typename F>
+    void forEachRaw(F visit) {
+        if (haveContent) {
+            ScopedPhase phase(PHASE_PARSE);
+            forEachObject(content, 0, visit);
+            return;
+        }
+        
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        const size_t BLOCK = 1 << 20;
+        string buffer;
+        size_t pos = 0;
+        while (true) {
+            // Keep the unfinished object, append the next block
+            buffer.erase(0, pos);
+            size_t kept = buffer.size();
+            buffer.resize(kept + BLOCK);
+            ssize_t got;
+            {
+                ScopedPhase phase(PHASE_READ);
+                got = read(fd, &buffer[kept], BLOCK);
+                if (got > 0) timings.bytesRead += got;
+            }
+            buffer.resize(kept + max<ssize_t>(got, 0));
+            if (got <= 0) break;
+            
+            ScopedPhase phase(PHASE_PARSE);
+            pos = forEachObject(buffer, 0, visit);
+            if (pos == string::npos) break;
+        }
+        ::close(fd);
+    }
+    
+    // Files larger than this are scanned by streaming instead of being
+    // loaded: TASK_STREAM_BYTES, or a quarter of the free memory, since
+    // parsed tasks take a few times their size in the file
+    static size_t streamThreshold() {
+        const char* env = getenv("TASK_STREAM_BYTES");
+        if (env != nullptr && *env != '\0') return strtoull(env, nullptr, 10);
+        return (size_t)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / 4;
+    }
+    
+    void load() {
+        if (loaded) return;
+        loaded = true;
+        readContent();
+        
+        ScopedPhase phase(PHASE_PARSE);
+        if (!content.empty() && !ParseCache::load(path, content, tasks)) {
+            if (fileIsNdjson) {
+                tasks = parseNdjsonParallel(content);
+            }
+            else {
+                parseTasks(content, [&](TaskTracker&& task) { tasks.push_back(move(task)); });
+            }
+            cacheWanted = ParseCache::describe(path, content, cacheHeader);
+        }
+        for (size_t slot = 0; slot < tasks.size(); slot++) {
+            slots[tasks[slot].getId()] = slot;
+            maxId = max(maxId, tasks[slot].getId());
+        }
+        timings.tasksLoaded += tasks.size();
+        content = string();
+        
+        // Replay changes made before the load
+        for (const auto& entry : edits) {
+            if (entry.second.removed) remove(entry.first);
+            else upsert(entry.second.task);
+        }
+        for (const auto& entry : added) upsert(entry.second);
+        edits.clear();
+        added.clear();
+        
+        // An array file is converted when NDJSON is preferred
+        if (ndjson != fileIsNdjson) dirty = true;
+    }
+    
+    template <typename Tasks>
+    void appendLines(const Tasks& batch) {
+        ScopedPhase phase(PHASE_WRITE);
+        string lines;
+        for (const TaskTracker* task : batch) {
+            lines += task->toCompactJson();
+            lines += '\n';
+            timings.tasksSaved++;
+        }
+        ofstream file(path, ios::app);
+        file.write(lines.data(), lines.size());
+        timings.bytesWritten += lines.size();
+        if (haveContent) content += lines;
+        foundId = 0;
+    }
+    
+    // Write content with the edits and additions spliced in
+    void spliceEdits() {
+        ScopedPhase phase(PHASE_SERIALIZE);
+        vector<const RawEdit*> order;
+        for (const auto& entry : edits) order.push_back(&entry.second);
+        sort(order.begin(), order.end(), [](const RawEdit* a, const RawEdit* b) {
+            return a->start < b->start;
+        });
+        
+        string out;
+        out.reserve(content.size() + 256 * added.size());
+        size_t pos = 0;
+        for (const RawEdit* edit : order) {
+            out.append(content, pos, edit->start - pos);
+            pos = edit->end;
+            timings.tasksSaved++;
+            if (!edit->removed) {
+                out += ndjson ? edit->task.toCompactJson() : edit->task.toJson();
+                continue;
+            }
+            
+            // Drop the separator too: the line break after an NDJSON line,
+            // or the comma after (or, for the last task, before) an object
+            size_t next = content.find_first_not_of(" \t\r\n", pos);
+            if (ndjson) {
+                if (pos < content.size() && content[pos] == '\n') pos++;
+            }
+            else if (next != string::npos && content[next] == ',') {
+                pos = next + 1;
+                if (pos < content.size() && content[pos] == '\n') pos++;
+            }
+            else {
+                size_t last = out.find_last_not_of(" \t\r\n");
+                if (last != string::npos && out[last] == ',') out.erase(last);
+            }
+        }
+        out.append(content, pos, string::npos);
+        
+        if (!added.empty()) {
+            // New tasks go after the last object; an emptied array restarts
+            bool restart = !ndjson && out.rfind('}') == string::npos;
+            if (restart) out = "[\n\n]";
+            size_t insertAt = ndjson ? out.size() : restart ? 2 : out.rfind('}') + 1;
+            string more;
+            if (ndjson && !out.empty() && out.back() != '\n') more += '\n';
+            for (const auto& entry : added) {
+                more += ndjson ? entry.second.toCompactJson() + "\n" : ",\n" + entry.second.toJson();
+                timings.tasksSaved++;
+            }
+            out.insert(insertAt, restart ? more.substr(2) : more);
+        }
+        
+        ScopedPhase write(PHASE_WRITE);
+        ofstream file(path);
+        file.write(out.data(), out.size());
+        timings.bytesWritten += out.size();
+        file.close();
+        content = move(out);
+        foundId = 0;
+        edits.clear();
+        added.clear();
+    }
+    
+public:
+    // fresh: start empty and overwrite the file on commit
+    JsonFileEngine(const string& file, bool preferNdjson, bool fresh = false) :
+        path(file), ndjson(preferNdjson) {
+        if (fresh) {
+            loaded = true;
+            dirty = true;
+            return;
+        }
+        
+        // The first character tells the encodings apart: '[' or '{'. A
+        // missing or empty file can take appends either way.
+        ifstream in(path);
+        char first = 0;
+        while (in.get(first) && isspace((unsigned char)first)) {}
+        fileIsNdjson = !in || first == '{';
+        if (in && first == '{') ndjson = true;
+    }
+    
+    ~JsonFileEngine() {
+        if (cacheWanted) ParseCache::save(path, cacheHeader, tasks);
+    }
+    
+    string name() const override {
+        return ndjson ? "ndjson" : "json";
+    }
+    
+    string location() const override {
+        return path;
+    }
+    
+    int nextId() override {
+        if (loaded) return maxId + 1;
+        if (rawMaxId < 0) {
+            rawMaxId = 0;
+            readContent();
+            const char* p = content.data();
+            const char* end = p + content.size();
+            while ((p = (const char*)memmem(p, end - p, "\"id\": ", 6)) != nullptr) {
+                p += 6;
+                rawMaxId = max(rawMaxId, atoi(p));
+            }
+        }
+        int highest = rawMaxId;
+        if (!added.empty()) highest = max(highest, added.rbegin()->first);
+        return highest + 1;
+    }
+    
+    bool get(int id, TaskTracker& out) override {
+        if (loaded) {
+            auto it = slots.find(id);
+            if (it == slots.end()) return false;
+            out = tasks[it->second];
+            return true;
+        }
+        
+        auto edit = edits.find(id);
+        if (edit != edits.end()) {
+            if (edit->second.removed) return false;
+            out = edit->second.task;
+            return true;
+        }
+        auto add = added.find(id);
+        if (add != added.end()) {
+            out = add->second;
+            return true;
+        }
+        pair<size_t, size_t> range = findObject(id);
+        if (range.first == string::npos) return false;
+        out = parseObject(string_view(content).substr(range.first, range.second - range.first));
+        return true;
+    }
+    
+    void upsert(const TaskTracker& task) override {
+        cacheWanted = false;
+        if (!loaded) {
+            auto edit = edits.find(task.getId());
+            if (edit != edits.end()) {
+                edit->second.removed = false;
+                edit->second.task = task;
+                return;
+            }
+            pair<size_t, size_t> range = findObject(task.getId());
+            if (range.first != string::npos) {
+                edits[task.getId()] = { range.first, range.second, false, task };
+            }
+            else {
+                added.insert_or_assign(task.getId(), task);
+                if (rawMaxId >= 0) rawMaxId = max(rawMaxId, task.getId());
+            }
+            return;
+        }
+        
+        auto it = slots.find(task.getId());
+        if (it != slots.end()) {
+            tasks[it->second] = task;
+            dirty = true;
+            return;
+        }
+        slots[task.getId()] = tasks.size();
+        appended.push_back(tasks.size());
+        tasks.push_back(task);
+        maxId = max(maxId, task.getId());
+    }
+    
+    bool remove(int id) override {
+        cacheWanted = false;
+        if (!loaded) {
+            if (added.erase(id)) return true;
+            auto edit = edits.find(id);
+            if (edit != edits.end()) {
+                if (edit->second.removed) return false;
+                edit->second.removed = true;
+                return true;
+            }
+            pair<size_t, size_t> range = findObject(id);
+            if (range.first == string::npos) return false;
+            edits[id] = { range.first, range.second, true, TaskTracker(id) };
+            return true;
+        }
+        
+        auto it = slots.find(id);
+        if (it == slots.end()) return false;
+        tasks[it->second].deleteTask();
+        slots.erase(it);
+        dirty = true;
+        return true;
+    }
+    
+    void scan(const TaskPredicate& pred, const TaskVisitor& visit) override {
+        struct stat st;
+        if (!loaded && !haveContent && edits.empty() && added.empty() &&
+            stat(path.c_str(), &st) == 0 && (size_t)st.st_size > streamThreshold()) {
+            forEachRaw([&](string_view object, string_view) {
+                TaskTracker task = parseObject(object);
+                if (!pred || pred(task)) visit(task);
+                return true;
+            });
+            return;
+        }
+        
+        load();
+        for (const auto& task : tasks) {
+            if (!task.isTaskDeleted() && (!pred || pred(task))) visit(task);
+        }
+    }
+    
+    void scanStatus(const string& status, const TaskVisitor& visit) override {
+        if (loaded || !edits.empty() || !added.empty()) {
+            StorageEngine::scanStatus(status, visit);
+            return;
+        }
+        forEachRaw([&](string_view object, string_view taskStatus) {
+            if (taskStatus == status) visit(parseObject(object));
+            return true;
+        });
+    }
+    
+    void scanUntil(const StatusFilter& wanted, const TaskPredicate& visit) override {
+        if (loaded || !edits.empty() || !added.empty()) {
+            load();
+            for (const auto& task : tasks) {
+                if (!task.isTaskDeleted() && wanted(task.status) && !visit(task)) return;
+            }
+            return;
+        }
+        forEachRaw([&](string_view object, string_view status) {
+            return !wanted(status) || visit(parseObject(object));
+        });
+    }
+    
+    void countByStatus(map<string, size_t>& counts) override {
+        if (loaded || !edits.empty() || !added.empty()) {
+            StorageEngine::countByStatus(counts);
+            return;
+        }
+        forEachRaw([&](string_view, string_view status) {
+            counts[string(status)]++;
+            return true;
+        });
+    }
+    
+    void commit() override {
+        if (!loaded) {
+            if (edits.empty() && added.empty()) return;
+            if (ndjson && fileIsNdjson && edits.empty()) {
+                vector<const TaskTracker*> batch;
+                for (const auto& entry : added) batch.push_back(&entry.second);
+                appendLines(batch);
+                added.clear();
+                return;
+            }
+            readContent();
+            if (ndjson == fileIsNdjson && content.find('}') != string::npos) {
+                spliceEdits();
+                return;
+            }
+            load();
+        }
+        
+        if (ndjson && fileIsNdjson && !dirty && !appended.empty()) {
+            vector<const TaskTracker*> batch;
+            for (size_t slot : appended) {
+                if (!tasks[slot].isTaskDeleted()) batch.push_back(&tasks[slot]);
+            }
+            appendLines(batch);
+            appended.clear();
+            return;
+        }
+        
+        writeTasksFile(path, [&](auto visit) {
+            for (const auto& task : tasks) {
+                if (!task.isTaskDeleted()) visit(task);
+            }
+        }, ndjson);
+        fileIsNdjson = ndjson;
+        dirty = false;
+        appended.clear();
+    }
+    
+    void sync() override {
+        syncFile(path);
+    }
+    
+    void destroy() override {
+        cacheWanted = false;
+        rename(path.c_str(), (path + ".bak").c_str());
+        ParseCache::remove(path);
+    }
+};
+
+// Tasks split into id-range shard files (see ShardStore). Only the shards an
+// operation touches are loaded, and commit rewrites only modified shards.
+// Scans load the remaining shards on parallel threads.
+class ShardedEngine : public StorageEngine {
+private:
+    struct Shard {
+        ChunkedVector<TaskTracker> tasks;
+        unordered_map<int, size_t> slots;   // live id -> slot
+        bool dirty = false;
+    };
+    
+    ShardStore store;
+    map<long, Shard> loaded;
+    bool manifestDirty = false;
+    vector<string> unsynced;            // files written since the last sync
+    
+    static void addLoaded(Shard& shard, ChunkedVector<TaskTracker>& tasks) {
+        shard.tasks = move(tasks);
+        for (size_t slot = 0; slot < shard.tasks.size(); slot++) {
+            shard.slots[shard.tasks[slot].getId()] = slot;
+        }
+        timings.tasksLoaded += shard.tasks.size();
+    }
+    
+    // The shard owning an id, loaded if it exists and is not loaded yet
+    Shard& shardFor(int id) {
+        long number = store.shardOf(id);
+        auto it = loaded.find(number);
+        if (it != loaded.end()) return it->second;
+        
+        Shard& shard = loaded[number];
+        if (!store.shards.count(number)) return shard;
+        
+        string content;
+        {
+            ScopedPhase phase(PHASE_READ);
+            if (!readFile(store.shardPath(number), content)) return shard;
+            timings.bytesRead += content.size();
+        }
+        ScopedPhase phase(PHASE_PARSE);
+        ChunkedVector<TaskTracker> tasks;
+        parseTasks(content, [&](TaskTracker&& task) { tasks.push_back(move(task)); });
+        addLoaded(shard, tasks);
+        return shard;
+    }
+    
+    // Load every shard not loaded yet, reading and parsing them in parallel.
+    // Reading and parsing overlap across threads, so both count as "parse".
+    void loadAll() {
+        vector<long> pending;
+        for (long number : store.shards) {
+            if (!loaded.count(number)) pending.push_back(number);
+        }
+        if (pending.empty()) return;
+        
+        ScopedPhase phase(PHASE_PARSE);
+        vector<ChunkedVector<TaskTracker>> parsed(pending.size());
+        vector<size_t> bytes(pending.size(), 0);
+        atomic<size_t> next{0};
+        auto worker = [&]() {
+            size_t i;
+            while ((i = next++) < pending.size()) {
+                string content;
+                if (!readFile(store.shardPath(pending[i]), content)) continue;
+                bytes[i] = content.size();
+                parseTasks(content, [&](TaskTracker&& task) { parsed[i].push_back(move(task)); });
+            }
+        };
+        
+        size_t threadCount = min<size_t>(max(1u, thread::hardware_concurrency()), pending.size());
+        vector<thread> threads;
+        for (size_t t = 1; t < threadCount; t++) threads.emplace_back(worker);
+        worker();
+        for (auto& t : threads) t.join();
+        
+        for (size_t i = 0; i < pending.size(); i++) {
+            addLoaded(loaded[pending[i]], parsed[i]);
+            timings.bytesRead += bytes[i];
+        }
+    }
+    
+public:
+    // fresh: ignore existing shards (they are replaced on commit)
+    ShardedEngine(const string& dir, int shardSize, bool fresh = false) {
+        store.dir = dir;
+        store.shardSize = shardSize;
+        if (!fresh && ShardStore::exists(dir)) store.loadManifest();
+        manifestDirty = fresh;
+    }
+    
+    string name() const override {
+        return "sharded";
+    }
+    
+    string location() const override {
+        return store.dir;
+    }
+    
+    int nextId() override {
+        return store.nextId;
+    }
+    
+    bool get(int id, TaskTracker& out) override {
+        Shard& shard = shardFor(id);
+        auto it = shard.slots.find(id);
+        if (it == shard.slots.end()) return false;
+        out = shard.tasks[it->second];
+        return true;
+    }
+    
+    void upsert(const TaskTracker& task) override {
+        Shard& shard = shardFor(task.getId());
+        auto it = shard.slots.find(task.getId());
+        if (it != shard.slots.end()) {
+            shard.tasks[it->second] = task;
+        }
+        else {
+            shard.slots[task.getId()] = shard.tasks.size();
+            shard.tasks.push_back(task);
+        }
+        shard.dirty = true;
+        
+        if (store.shards.insert(store.shardOf(task.getId())).second) manifestDirty = true;
+        if (task.getId() >= store.nextId) {
+            store.nextId = task.getId() + 1;
+            manifestDirty = true;
+        }
+    }
+    
+    bool remove(int id) override {
+        Shard& shard = shardFor(id);
+        auto it = shard.slots.find(id);
+        if (it == shard.slots.end()) return false;
+        shard.tasks[it->second].deleteTask();
+        shard.slots.erase(it);
+        shard.dirty = true;
+        return true;
+    }
+    
+    void scan(const TaskPredicate& pred, const TaskVisitor& visit) override {
+        loadAll();
+        for (const auto& entry : loaded) {
+            for (const auto& task : entry.second.tasks) {
+                if (!task.isTaskDeleted() && (!pred || pred(task))) visit(task);
+            }
+        }
+    }
+    
+    // Loads one shard at a time, in order, up to the one where visit stops
+    void scanUntil(const StatusFilter& wanted, const TaskPredicate& visit) override {
+        for (long number : store.shards) {
+            for (const auto& task : shardFor((int)(number * store.shardSize)).tasks) {
+                if (!task.isTaskDeleted() && wanted(task.status) && !visit(task)) return;
+            }
+        }
+    }
+    
+    void commit() override {
+        if (mkdir(store.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            cerr << "Error: Cannot create " << store.dir << ": " << strerror(errno) << endl;
+            return;
+        }
+        for (auto& entry : loaded) {
+            Shard& shard = entry.second;
+            if (!shard.dirty) continue;
+            string path = store.shardPath(entry.first);
+            writeTasksFile(path + ".tmp", [&](auto visit) {
+                for (const auto& task : shard.tasks) {
+                    if (!task.isTaskDeleted()) visit(task);
+                }
+            });
+            rename((path + ".tmp").c_str(), path.c_str());
+            shard.dirty = false;
+            unsynced.push_back(path);
+        }
+        if (manifestDirty) {
+            store.saveManifest();
+            unsynced.push_back(store.dir + "/manifest");
+        }
+        manifestDirty = false;
+    }
+    
+    void sync() override {
+        for (const string& path : unsynced) syncFile(path);
+        if (!unsynced.empty()) syncFile(store.dir);
+        unsynced.clear();
+    }
+    
+    void destroy() override {
+        for (long number : store.shards) unlink(store.shardPath(number).c_str());
+        unlink((store.dir + "/manifest").c_str());
+        rmdir(store.dir.c_str());
+    }
+};
+
+// Memory-mapped fixed-width records (see RecordStore). Nothing is loaded up
+// front: get binary-searches the mapping, and upsert writes only the fields
+// that changed straight into the record, so commit has nothing left to do.
+class RecordEngine : public StorageEngine {
+private:
+    string base;
+    RecordStore store;
+    
+    // Status straight from the mapped record; descriptions stay on disk
+    string_view statusOf(size_t index) {
+        const TaskRecord& rec = store.at(index);
+        return string_view(rec.status, strnlen(rec.status, sizeof(rec.status)));
+    }
+    
+public:
+    // fresh: replace any existing record files
+    RecordEngine(const string& baseName, bool fresh = false) : base(baseName) {
+        bool ok = !fresh && RecordStore::exists(base) ? store.open(base) : store.create(base);
+        if (!ok) {
+            cerr << "Error: Cannot open " << base << ".rec as a record file" << endl;
+            exit(1);
+        }
+    }
+    
+    string name() const override {
+        return "records";
+    }
+    
+    string location() const override {
+        return base + ".rec";
+    }
+    
+    int nextId() override {
+        return store.nextId();
+    }
+    
+    bool get(int id, TaskTracker& out) override {
+        long index = store.find(id);
+        if (index < 0 || store.at(index).deleted) return false;
+        ScopedPhase phase(PHASE_PARSE);
+        out = store.read(index);
+        timings.tasksLoaded++;
+        return true;
+    }
+    
+    void upsert(const TaskTracker& task) override {
+        ScopedPhase phase(PHASE_WRITE);
+        long index = store.find(task.getId());
+        if (index < 0) store.insert(task);
+        else store.write(index, task);
+        timings.tasksSaved++;
+    }
+    
+    bool remove(int id) override {
+        long index = store.find(id);
+        if (index < 0 || store.at(index).deleted) return false;
+        ScopedPhase phase(PHASE_WRITE);
+        store.remove(index);
+        return true;
+    }
+    
+    void scan(const TaskPredicate& pred, const TaskVisitor& visit) override {
+        for (size_t i = 0; i < store.count(); i++) {
+            if (store.at(i).deleted) continue;
+            TaskTracker task = store.read(i);
+            timings.tasksLoaded++;
+            if (!pred || pred(task)) visit(task);
+        }
+    }
+    
+    void scanStatus(const string& status, const TaskVisitor& visit) override {
+        for (size_t i = 0; i < store.count(); i++) {
+            if (store.at(i).deleted || statusOf(i) != status) continue;
+            timings.tasksLoaded++;
+            visit(store.read(i));
+        }
+    }
+    
+    void scanUntil(const StatusFilter& wanted, const TaskPredicate& visit) override {
+        for (size_t i = 0; i < store.count(); i++) {
+            if (store.at(i).deleted || !wanted(statusOf(i))) continue;
+            timings.tasksLoaded++;
+            if (!visit(store.read(i))) return;
+        }
+    }
+    
+    void countByStatus(map<string, size_t>& counts) override {
+        for (size_t i = 0; i < store.count(); i++) {
+            if (!store.at(i).deleted) counts[string(statusOf(i))]++;
+        }
+    }
+    
+    void commit() override {
+        // Records were written in place by upsert and remove
+    }
+    
+    void sync() override {
+        store.sync();
+    }
+    
+    void destroy() override {
+        store.close();
+        unlink((base + ".rec").c_str());
+        unlink((base + ".heap").c_str());
+    }
+};
+
+// Page-based B+tree (see BTreeStore) for very large trackers: point
+// operations read and write O(log N) pages through a fixed-size buffer
+// pool, and commit writes back the dirty pages through its redo log.
+class BTreeEngine : public StorageEngine {
+private:
+    string base;
+    BTreeStore store;
+    
+public:
+    // fresh: replace any existing tree
+    BTreeEngine(const string& baseName, bool fresh = false) : base(baseName) {
+        bool ok = !fresh && BTreeStore::exists(base) ? store.open(base) : store.create(base);
+        if (!ok) {
+            cerr << "Error: Cannot open " << base << ".btree as a B+tree file" << endl;
+            exit(1);
+        }
+    }
+    
+    string name() const override {
+        return "btree";
+    }
+    
+    string location() const override {
+        return base + ".btree";
+    }
+    
+    int nextId() override {
+        return store.nextId();
+    }
+    
+    bool get(int id, TaskTracker& out) override {
+        if (!store.get(id, out)) return false;
+        timings.tasksLoaded++;
+        return true;
+    }
+    
+    void upsert(const TaskTracker& task) override {
+        store.upsert(task);
+        timings.tasksSaved++;
+    }
+    
+    bool remove(int id) override {
+        return store.remove(id);
+    }
+    
+    void scan(const TaskPredicate& pred, const TaskVisitor& visit) override {
+        store.scan([&](const TaskTracker& task) {
+            timings.tasksLoaded++;
+            if (!pred || pred(task)) visit(task);
+            return true;
+        });
+    }
+    
+    void scanUntil(const StatusFilter& wanted, const TaskPredicate& visit) override {
+        store.scan([&](const TaskTracker& task) {
+            timings.tasksLoaded++;
+            return !wanted(task.status) || visit(task);
+        });
+    }
+    
+    void commit() override {
+        store.commit();
+    }
+    
+    void sync() override {
+        store.sync();
+    }
+    
+    void destroy() override {
+        store.close();
+        unlink((base + ".btree").c_str());
+        unlink((base + ".btree.wal").c_str());
+    }
+};
+
+const char* STORAGE_KINDS[] = { "json", "ndjson", "sharded", "records", "btree" };
+
+// Storage for a tasks file: TASK_STORAGE, else "storage" in tasks.conf, else
+// whichever layout already exists next to the file, else JSON (NDJSON if
+// TASK_FORMAT=ndjson)
+string configuredStorage(const string& file) {
+    const char* env = getenv("TASK_STORAGE");
+    if (env != nullptr && *env != '\0') return env;
+    
+    map<string, string> config = readConfig(baseName(file) + ".conf");
+    if (config.count("storage")) return config["storage"];
+    
+    if (RecordStore::exists(baseName(file))) return "records";
+    if (BTreeStore::exists(baseName(file))) return "btree";
+    if (ShardStore::exists(baseName(file) + ".d")) return "sharded";
+    const char* format = getenv("TASK_FORMAT");
+    return format != nullptr && strcmp(format, "ndjson") == 0 ? "ndjson" : "json";
+}
+
+// Create the engine of the given kind for a tasks file; nullptr if the kind
+// is unknown. fresh engines start empty and replace existing data on commit.
+unique_ptr<StorageEngine> openStorage(const string& kind, const string& file,
+                                      bool fresh = false, int shardSize = 10000) {
+    if (kind == "json" || kind == "ndjson") {
+        return unique_ptr<StorageEngine>(new JsonFileEngine(file, kind == "ndjson", fresh));
+    }
+    if (kind == "sharded") {
+        return unique_ptr<StorageEngine>(new ShardedEngine(baseName(file) + ".d", shardSize, fresh));
+    }
+    if (kind == "records") {
+        return unique_ptr<StorageEngine>(new RecordEngine(baseName(file), fresh));
+    }
+    if (kind == "btree") {
+        return unique_ptr<StorageEngine>(new BTreeEngine(baseName(file), fresh));
+    }
+    return nullptr;
+}
+
+class TaskManager {
+private:
+    string filename = "tasks.json";
+    unique_ptr<StorageEngine> store;
+    
+    // Done tasks older than archiveDays move to the archive tier (see
+    // ArchiveStore) at most once a day, when a command saves the tasks
+    ArchiveStore archive;
+    int archiveDays = 30;
+    
+    // See setResident
+    bool resident = false;
+    
+    // In a resident manager, built on the first time-range query and then
+    // kept in sync by every mutation
+    TimeIndex createdIndex;
+    TimeIndex updatedIndex;
+    bool timeIndexed = false;
+    
+    void buildTimeIndex() {
+        createdIndex.clear();
+        updatedIndex.clear();
+        timeIndexed = true;
+        store->scan(nullptr, [&](const TaskTracker& task) {
+            timings.tasksScanned++;
+            indexTask(task);
+        });
+    }
+    
+    void indexTask(const TaskTracker& task) {
+        if (!timeIndexed) return;
+        createdIndex.insert(clockKey(task.createdAt), task.getId());
+        updatedIndex.insert(clockKey(task.updatedAt), task.getId());
+    }
+    
+    void unindexTask(const TaskTracker& task) {
+        if (!timeIndexed) return;
+        createdIndex.erase(clockKey(task.createdAt), task.getId());
+        updatedIndex.erase(clockKey(task.updatedAt), task.getId());
+    }
+    
+    void showTask(const TaskTracker& task) {
+        ScopedPhase phase(PHASE_OUTPUT);
+        task.display();
+        timings.linesOutput++;
+    }
+    
+    // Fetch a live task by id
+    bool findTask(int id, TaskTracker& task) {
+        ScopedPhase phase(PHASE_LOOKUP);
+        timings.tasksScanned++;
+        return store->get(id, task);
+    }
+    
+    // Ids of todo tasks for claim in a resident manager, lowest first. Built
+    // on the first claim, then kept in sync by every mutation.
+    set<int> todoQueue;
+    bool todoQueued = false;
+    
+    // Claims hold a lease (the "lease" field, an expiry time) that
+    // heartbeat renews; lapsed tasks go back to todo. In a resident manager
+    // each leased task has one timer in the wheel, built on the first
+    // expiry check and then moved or dropped by every mutation; a one-shot
+    // claim checks the leases it passes instead (see claimTask).
+    int leaseSeconds = 300;
+    TimerWheel leases;
+    bool leasesTracked = false;
+    
+    static time_t leaseOf(const TaskTracker& task) {
+        return task.status == "in-progress" ? parseTimestamp(task.field("lease")) : -1;
+    }
+    
+    // One heap per status for "next" in a resident manager, built on first
+    // use and then kept up to date by every mutation
+    map<string, IndexedHeap> byPriority;
+    bool prioritiesIndexed = false;
+    
+    // Ids per tag and per status for tag filters in a resident manager, built
+    // on first use and then kept up to date by every mutation. tagsOf
+    // remembers the tags of each tagged task so a change knows which bitmaps
+    // to leave.
+    map<string, RoaringBitmap> byTag;
+    map<string, RoaringBitmap> statusBits;
+    unordered_map<int, vector<string>> tagsOf;
+    bool tagsIndexed = false;
+    
+    void indexTags(int id, const TaskTracker* task) {
+        auto old = tagsOf.find(id);
+        if (old != tagsOf.end()) {
+            for (const string& tag : old->second) {
+                auto bits = byTag.find(tag);
+                bits->second.remove(id);
+                if (bits->second.size() == 0) byTag.erase(bits);
+            }
+            tagsOf.erase(old);
+        }
+        for (auto& bits : statusBits) bits.second.remove(id);
+        if (task == nullptr) return;
+        
+        statusBits[task->status].add(id);
+        vector<string> tags = task->tags();
+        for (const string& tag : tags) byTag[tag].add(id);
+        if (!tags.empty()) tagsOf[id] = move(tags);
+    }
+    
+    // Dependencies for "list --ready" in a resident manager: for each task
+    // what it waits for, who waits for it, and how many of its dependencies
+    // are not done yet. Built on first use (one full scan), then a change
+    // adjusts only the counters of the changed task's dependents, so the
+    // todo tasks with none left (ready) are always at hand. A one-shot
+    // command never builds it. A task that is gone no longer blocks anyone.
+    struct DependencyNode {
+        vector<int> deps;
+        vector<int> waiting;
+        int blocking = 0;
+        bool present = false;
+        bool done = false;
+        bool todo = false;
+    };
+    unordered_map<int, DependencyNode> dependencyGraph;
+    set<int> ready;
+    bool dependenciesIndexed = false;
+    
+    void updateReady(int id, const DependencyNode& node) {
+        if (node.present && node.todo && node.blocking == 0) ready.insert(id);
+        else ready.erase(id);
+    }
+    
+    void indexDependencies(int id, const TaskTracker* task) {
+        DependencyNode& node = dependencyGraph[id];
+        bool blocked = node.present && !node.done;
+        
+        // Drop the old edges, then add the current ones
+        for (int dep : node.deps) {
+            DependencyNode& other = dependencyGraph.at(dep);
+            other.waiting.erase(find(other.waiting.begin(), other.waiting.end(), id));
+            if (other.present && !other.done) node.blocking--;
+        }
+        node.deps = task != nullptr ? task->dependencies() : vector<int>();
+        for (int dep : node.deps) {
+            DependencyNode& other = dependencyGraph[dep];
+            other.waiting.push_back(id);
+            if (other.present && !other.done) node.blocking++;
+        }
+        
+        node.present = task != nullptr;
+        node.done = node.present && task->status == "done";
+        node.todo = node.present && task->status == "todo";
+        updateReady(id, node);
+        
+        bool blocks = node.present && !node.done;
+        if (blocks == blocked) return;
+        for (int waiter : node.waiting) {
+            DependencyNode& other = dependencyGraph.at(waiter);
+            other.blocking += blocks ? 1 : -1;
+            updateReady(waiter, other);
+        }
+    }
+    
+    void indexAllDependencies() {
+        if (dependenciesIndexed) return;
+        ScopedPhase phase(PHASE_LOOKUP);
+        store->scan(nullptr, [&](const TaskTracker& task) { indexDependencies(task.getId(), &task); });
+        dependenciesIndexed = true;
+    }
+    
+    // Whether to is reachable from from by following dependencies, read
+    // from the graph when it is built. Otherwise one pass collects every
+    // task's dependencies first and the walk stays in memory; looking each
+    // hop up would cost a read of the file per hop in raw JSON mode.
+    bool dependsOn(int from, int to) {
+        unordered_map<int, vector<int>> edges;
+        if (!dependenciesIndexed) {
+            // scanUntil rather than scan: a JSON file stays unloaded, so the
+            // change is still spliced in rather than rewriting the file
+            ScopedPhase phase(PHASE_LOOKUP);
+            store->scanUntil([](string_view) { return true; }, [&](const TaskTracker& task) {
+                timings.tasksScanned++;
+                vector<int> deps = task.dependencies();
+                if (!deps.empty()) edges.emplace(task.getId(), move(deps));
+                return true;
+            });
+        }
+        vector<int> pending = {from};
+        unordered_set<int> seen = {from};
+        while (!pending.empty()) {
+            int id = pending.back();
+            pending.pop_back();
+            if (id == to) return true;
+            const vector<int>* deps = nullptr;
+            if (dependenciesIndexed) {
+                auto node = dependencyGraph.find(id);
+                if (node != dependencyGraph.end()) deps = &node->second.deps;
+            }
+            else {
+                auto node = edges.find(id);
+                if (node != edges.end()) deps = &node->second;
+            }
+            if (deps == nullptr) continue;
+            for (int dep : *deps) {
+                if (seen.insert(dep).second) pending.push_back(dep);
+            }
+        }
+        return false;
+    }
+    
+    // A subtask holds its parent's id in the "parent" field, and a parent
+    // holds "progress", done/total over all its descendants. A change to a
+    // task adjusts the progress of its ancestors only, so nothing is ever
+    // recounted; archiving a done task leaves it counted. A parent has a
+    // lower id than its children (it existed first), which rules out cycles;
+    // tasks whose parent is gone become roots.
+    static pair<long, long> progressOf(const TaskTracker& task) {
+        long done = 0, total = 0;
+        sscanf(task.field("progress").c_str(), "%ld/%ld", &done, &total);
+        return { done, total };
+    }
+    
+    // What a task (nullptr for none) counts for in each ancestor's progress
+    static pair<long, long> shareOf(const TaskTracker* task) {
+        if (task == nullptr) return { 0, 0 };
+        pair<long, long> below = progressOf(*task);
+        return { below.first + (task->status == "done" ? 1 : 0), below.second + 1 };
+    }
+    
+    // Add done and total to the progress of the ancestors of task id, which
+    // start at parent
+    void rollUp(int id, int parent, long done, long total) {
+        if (done == 0 && total == 0) return;
+        TaskTracker task(parent);
+        while (parent > 0 && parent < id && findTask(parent, task)) {
+            pair<long, long> progress = progressOf(task);
+            progress.first += done;
+            progress.second += total;
+            task.setField("progress", progress.second > 0 ?
+                          to_string(progress.first) + "/" + to_string(progress.second) : "");
+            store->upsert(task);
+            changed(parent, &task);
+            id = parent;
+            parent = task.parentId();
+        }
+    }
+    
+    // Move a task's share of progress from its ancestors before the change
+    // to those after it (nullptr: the task did not or does not exist)
+    void rollUp(const TaskTracker* before, const TaskTracker* after) {
+        pair<long, long> was = shareOf(before), now = shareOf(after);
+        int id = after != nullptr ? after->getId() : before->getId();
+        int from = before != nullptr ? before->parentId() : 0;
+        int to = after != nullptr ? after->parentId() : 0;
+        if (from == to) {
+            rollUp(id, to, now.first - was.first, now.second - was.second);
+        }
+        else {
+            rollUp(id, from, -was.first, -was.second);
+            rollUp(id, to, now.first, now.second);
+        }
+    }
+    
+    // Told about every task stored or (nullptr) removed; see TaskServer
+    function<void(int, const TaskTracker*)> onChange;
+    
+    void changed(int id, const TaskTracker* task) {
+        if (todoQueued) {
+            if (task != nullptr && task->status == "todo") todoQueue.insert(id);
+            else todoQueue.erase(id);
+        }
+        if (prioritiesIndexed) {
+            for (auto& heap : byPriority) {
+                if (task == nullptr || heap.first != task->status) heap.second.remove(id);
+            }
+            if (task != nullptr) byPriority[task->status].set(id, task->priority());
+        }
+        if (tagsIndexed) indexTags(id, task);
+        if (dependenciesIndexed) indexDependencies(id, task);
+        if (leasesTracked) {
+            time_t lease = task != nullptr ? leaseOf(*task) : -1;
+            if (lease != -1) leases.add(id, lease);
+            else leases.remove(id);
+        }
+        if (onChange) onChange(id, task);
+    }
+    
+    // Store a changed task and keep the indexes in sync
+    void replaceTask(const TaskTracker& before, const TaskTracker& after) {
+        unindexTask(before);
+        store->upsert(after);
+        indexTask(after);
+        changed(after.getId(), &after);
+        rollUp(&before, &after);
+    }
+    
+    static string formatTime(time_t t) {
+        char* dt = ctime(&t);
+        string timeStr(dt);
+        timeStr.pop_back(); // Remove newline
+        return timeStr;
+    }
+    
+    string getCurrentTime() {
+        return formatTime(time(0));
+    }
+    
+    void open() {
+        archive.dir = baseName(filename) + ".archive";
+        if (ArchiveStore::exists(archive.dir)) archive.loadManifest();
+        
+        map<string, string> config = readConfig(baseName(filename) + ".conf");
+        const char* days = getenv("TASK_ARCHIVE_DAYS");
+        if (days != nullptr && *days != '\0') archiveDays = atoi(days);
+        else if (config.count("archive-days")) archiveDays = atoi(config["archive-days"].c_str());
+        if (config.count("lease-seconds")) leaseSeconds = atoi(config["lease-seconds"].c_str());
+        
+        string kind = configuredStorage(filename);
+        int shardSize = config.count("shard-size") ? atoi(config["shard-size"].c_str()) : 10000;
+        store = openStorage(kind, filename, false, shardSize > 0 ? shardSize : 10000);
+        if (!store) {
+            cerr << "Error: Unknown storage '" << kind << "'" << endl;
+            exit(1);
+        }
+        
+        // Before the first archival run, count a day from when the tracker
+        // was created, so a new tracker is not scanned on its first save
+        if (!ArchiveStore::exists(archive.dir)) archive.lastRun = createdTime(store->location());
+    }
+    
+    // Archived ids are never handed out again
+    int nextTaskId() {
+        return max(store->nextId(), archive.maxId + 1);
+    }
+    
+    // Take tasks now in the archive out of the hot store. Their share stays
+    // in their ancestors' progress: an archived subtask is still done work
+    void dropArchived(const vector<TaskTracker>& moved) {
+        for (const auto& task : moved) {
+            unindexTask(task);
+            store->remove(task.getId());
+            changed(task.getId(), nullptr);
+        }
+        archiveMoved = true;
+    }
+    
+    // Set when tasks moved to the archive are waiting for the hot save
+    bool archiveMoved = false;
+    
+    // Once the hot save that dropped archived tasks is committed, sync it
+    // and clear the pending segments: their tasks are only in the archive now
+    void settleArchive() {
+        if (!archiveMoved) return;
+        archiveMoved = false;
+        store->sync();
+        archive.pending.clear();
+        archive.saveManifest();
+    }
+    
+    // Hot copies of tasks in pending archive segments: left by a crash after
+    // an archive run synced its segments but before the hot save did
+    vector<TaskTracker> staleArchived() {
+        vector<TaskTracker> stale;
+        unordered_set<int> ids = archive.pendingIds();
+        if (ids.empty()) return stale;
+        ScopedPhase phase(PHASE_LOOKUP);
+        store->scanStatus("done", [&](const TaskTracker& task) {
+            if (ids.count(task.getId())) stale.push_back(task);
+        });
+        return stale;
+    }
+    
+    // Move done tasks last updated before cutoff into new archive segments,
+    // one per month. The segments and the manifest listing them as pending
+    // are synced before the hot tasks are saved, so a crash in between
+    // leaves the tasks in both places but never loses them; finishArchive
+    // then drops the hot copies, and readers skip them until it has.
+    size_t archiveDoneTasks(time_t cutoff) {
+        vector<TaskTracker> moved;
+        {
+            ScopedPhase phase(PHASE_LOOKUP);
+            int64_t last = clockKey(cutoff);
+            store->scan([&](const TaskTracker& task) {
+                if (task.status != "done") return false;
+                int64_t updated = clockKey(task.updatedAt);
+                return updated != -1 && updated <= last;
+            }, [&](const TaskTracker& task) { moved.push_back(task); });
+        }
+        
+        // Nothing to move: the archive is only created once it has tasks
+        if (moved.empty()) {
+            archive.lastRun = time(0);
+            if (ArchiveStore::exists(archive.dir)) archive.saveManifest();
+            return 0;
+        }
+        
+        map<string, vector<const TaskTracker*>> byMonth;
+        for (const auto& task : moved) {
+            time_t updated = parseTimestamp(task.updatedAt);
+            char month[16];
+            struct tm tm;
+            localtime_r(&updated, &tm);
+            strftime(month, sizeof(month), "%Y-%m", &tm);
+            byMonth[month].push_back(&task);
+        }
+        
+        if (mkdir(archive.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            cout << "Error: Cannot create " << archive.dir << ": " << strerror(errno) << endl;
+            return 0;
+        }
+        for (const auto& month : byMonth) {
+            archive.addSegment(month.first, month.second);
+        }
+        archive.lastRun = time(0);
+        archive.maxId = nextTaskId() - 1;
+        archive.saveManifest();
+        dropArchived(moved);
+        return moved.size();
+    }
+    
+    bool archiveDue() const {
+        return archiveDays > 0 && time(0) - archive.lastRun >= 86400;
+    }
+    
+    void maybeArchive() {
+        if (!archiveDue()) return;
+        archiveDoneTasks(time(0) - (time_t)archiveDays * 86400);
+    }
+    
+    // Display archived tasks that pass the filter, except those the hot
+    // store still holds after an interrupted run; true if any were shown
+    template <typename F>
+    bool showArchived(F filter) {
+        unordered_set<int> hot;
+        for (const auto& task : staleArchived()) hot.insert(task.getId());
+        bool found = false;
+        archive.forEach([&](TaskTracker&& task) {
+            if (!hot.count(task.getId()) && filter(task)) {
+                showTask(task);
+                found = true;
+            }
+        });
+        return found;
+    }
+    
+    // List live tasks passing pred; false if there were none
+    bool showTasks(const TaskPredicate& pred) {
+        ScopedPhase phase(PHASE_LOOKUP);
+        bool found = false;
+        store->scan([&](const TaskTracker& task) {
+            timings.tasksScanned++;
+            return !pred || pred(task);
+        }, [&](const TaskTracker& task) {
+            showTask(task);
+            found = true;
+        });
+        return found;
+    }
+    
+    // With group commit on, mutations only mark the tasks for saving;
+    // flushCommits then saves them once for a whole batch
+    bool groupCommit = false;
+    bool commitPending = false;
+    
+    void saveTasks() {
+        if (groupCommit) {
+            commitPending = true;
+            return;
+        }
+        maybeArchive();
+        store->commit();
+        settleArchive();
+    }
+    
+public:
+    TaskManager() {
+        open();
+    }
+    
+    explicit TaskManager(const string& file) : filename(file) {
+        open();
+    }
+    
+    // Complete an archive run cut short before its hot save: drop the hot
+    // copies of the pending segments' tasks and clear them. Called with the
+    // tasks locked, before a command changes anything, so the copies are
+    // exactly those the run left behind.
+    void finishArchive() {
+        if (archive.pending.empty()) return;
+        vector<TaskTracker> stale = staleArchived();
+        if (!stale.empty()) dropArchived(stale);
+        archiveMoved = true;
+        store->commit();
+        settleArchive();
+    }
+    
+    // Defer saving to flushCommits (see TaskServer)
+    void setGroupCommit(bool on) {
+        groupCommit = on;
+    }
+    
+    // Mark the manager as kept loaded across commands (by TaskServer), where
+    // in-memory indexes built once pay off. A one-shot command would spend
+    // more building an index than answering with a single pass.
+    void setResident(bool on) {
+        resident = on;
+    }
+    
+    // Save and fsync everything changed since the last flush, with a single
+    // commit; false if nothing had changed
+    bool flushCommits() {
+        if (!commitPending) return false;
+        commitPending = false;
+        maybeArchive();
+        store->commit();
+        store->sync();
+        settleArchive();
+        return true;
+    }
+    
+    void setChangeListener(function<void(int, const TaskTracker*)> listener) {
+        onChange = move(listener);
+    }
+    
+    void scanTasks(const TaskVisitor& visit) {
+        store->scan(nullptr, visit);
+    }
+    
+    const ArchiveStore& archived() const {
+        return archive;
+    }
+    
+    // Read every task, as the first full listing would; returns the count.
+    // Commands load only what they need, so this is for benchmarks.
+    size_t load() {
+        size_t count = 0;
+        store->scan(nullptr, [&](const TaskTracker&) { count++; });
+        return count;
+    }
+    
+    // Commit without changing anything; loaded whole-file engines rewrite
+    // the file
+    void save() {
+        store->commit();
+    }
+    
+    string storageName() const {
+        return store->name();
+    }
+    
+    // Move every task into another storage engine and record the choice in
+    // tasks.conf. The old files are removed (tasks.json is kept as .bak).
+    void migrateStorage(const string& kind, int shardSize = 10000) {
+        if (kind == store->name()) {
+            cout << "Tasks are already stored as " << kind << endl;
+            return;
+        }
+        
+        vector<TaskTracker> all;
+        store->scan(nullptr, [&](const TaskTracker& task) { all.push_back(task); });
+        sort(all.begin(), all.end(), [](const TaskTracker& a, const TaskTracker& b) {
+            return a.getId() < b.getId();
+        });
+        
+        unique_ptr<StorageEngine> target = openStorage(kind, filename, true, shardSize);
+        if (!target) {
+            cout << "Error: Unknown storage '" << kind << "'" << endl;
+            return;
+        }
+        for (const auto& task : all) target->upsert(task);
+        target->commit();
+        if (target->location() != store->location()) store->destroy();
+        store = move(target);
+        
+        string configPath = baseName(filename) + ".conf";
+        map<string, string> config = readConfig(configPath);
+        config["storage"] = kind;
+        if (kind == "sharded") config["shard-size"] = to_string(shardSize);
+        writeConfig(configPath, config);
+        cout << "Moved " << all.size() << " tasks to " << kind << " storage in "
+             << store->location() << endl;
+    }
+    
+    // Write tasks as NDJSON to out, optionally only those with a status
+    void exportTasks(ostream& out, const string& status) {
+        store->scan([&](const TaskTracker& task) {
+            return status.empty() || task.status == status;
+        }, [&](const TaskTracker& task) {
+            ScopedPhase phase(PHASE_OUTPUT);
+            out << task.toCompactJson() << '\n';
+            timings.linesOutput++;
+        });
+    }
+    
+    void addTask(string description, int priority = 0, const vector<string>& tags = {}, int parent = 0) {
+        TaskTracker parentTask(parent);
+        if (parent != 0 && !findTask(parent, parentTask)) {
+            cout << "Task with ID " << parent << " not found" << endl;
+            return;
+        }
+        string currentTime = getCurrentTime();
+        TaskTracker newTask(nextTaskId());
+        newTask.addTask(description, "todo", currentTime, currentTime);
+        if (priority != 0) newTask.setField("priority", to_string(priority));
+        for (const string& tag : tags) newTask.setTag(tag, true);
+        if (parent != 0) newTask.setField("parent", to_string(parent));
+        store->upsert(newTask);
+        indexTask(newTask);
+        changed(newTask.getId(), &newTask);
+        rollUp(nullptr, &newTask);
+        saveTasks();
+        cout << "Task added successfully (ID: " << newTask.getId() << ")" << endl;
+    }
+    
+    void updateTask(int id, string description) {
+        TaskTracker task(id);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return;
+        }
+        TaskTracker before = task;
+        task.updateDescription(description, getCurrentTime());
+        replaceTask(before, task);
+        saveTasks();
+        cout << "Task updated successfully" << endl;
+    }
+    
+    void deleteTask(int id) {
+        TaskTracker task(id);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return;
+        }
+        unindexTask(task);
+        store->remove(id);
+        changed(id, nullptr);
+        rollUp(&task, nullptr);
+        saveTasks();
+        cout << "Task deleted successfully" << endl;
+    }
+    
+    void markInProgress(int id) {
+        TaskTracker task(id);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return;
+        }
+        TaskTracker before = task;
+        task.updateStatus("in-progress", getCurrentTime());
+        replaceTask(before, task);
+        saveTasks();
+        cout << "Task marked as in progress" << endl;
+    }
+    
+    void markDone(int id) {
+        TaskTracker task(id);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return;
+        }
+        TaskTracker before = task;
+        task.updateStatus("done", getCurrentTime());
+        task.setField("lease", "");
+        replaceTask(before, task);
+        saveTasks();
+        cout << "Task marked as done" << endl;
+    }
+    
+    // Put a task whose lease has run out back to todo, dropping its worker
+    // and lease; returns the task as stored
+    TaskTracker releaseTask(const TaskTracker& task) {
+        TaskTracker released = task;
+        released.updateStatus("todo", getCurrentTime());
+        released.setField("worker", "");
+        released.setField("lease", "");
+        replaceTask(task, released);
+        return released;
+    }
+    
+    // Put in-progress tasks whose lease has run out back to todo; returns
+    // how many. Called by TaskServer every second and by resident claims.
+    size_t expireLeases() {
+        time_t now = time(0);
+        vector<int> due;
+        if (!leasesTracked) {
+            ScopedPhase phase(PHASE_LOOKUP);
+            leases = TimerWheel(now);
+            leasesTracked = true;
+            store->scanStatus("in-progress", [&](const TaskTracker& task) {
+                time_t lease = leaseOf(task);
+                if (lease != -1 && lease <= now) due.push_back(task.getId());
+                else if (lease != -1) leases.add(task.getId(), lease);
+            });
+        }
+        leases.advance(now, [&](int id) { due.push_back(id); });
+        
+        size_t expired = 0;
+        for (int id : due) {
+            TaskTracker task(id);
+            if (!findTask(id, task)) continue;
+            time_t lease = leaseOf(task);
+            if (lease == -1 || lease > now) continue;
+            releaseTask(task);
+            expired++;
+        }
+        if (expired > 0) saveTasks();
+        return expired;
+    }
+    
+    // Mark the oldest todo task in progress, recording worker if given and
+    // leasing it for lease seconds (the configured default if negative, none
+    // if 0), and show it; false if there was none. Ids are handed out in
+    // creation order, so the oldest task is the one with the lowest id. A
+    // resident manager expires leases through the wheel and takes the task
+    // from todoQueue. A one-shot claim makes a single pass in id order up
+    // to the first todo task, returning lapsed leases it passes to todo and
+    // claiming the first of those if any; leases past that point lapse at
+    // a later claim. The pass is O(N) only when the oldest todo task is
+    // among the newest.
+    bool claimTask(const string& worker, int lease = -1) {
+        if (lease < 0) lease = leaseSeconds;
+        TaskTracker task(0);
+        if (resident) {
+            expireLeases();
+            if (!todoQueued) {
+                ScopedPhase phase(PHASE_LOOKUP);
+                store->scanStatus("todo", [&](const TaskTracker& todo) { todoQueue.insert(todo.getId()); });
+                todoQueued = true;
+            }
+            while (!todoQueue.empty() && task.getId() == 0) {
+                int id = *todoQueue.begin();
+                todoQueue.erase(todoQueue.begin());
+                if (!findTask(id, task) || task.status != "todo") task = TaskTracker(0);
+            }
+        }
+        else {
+            time_t now = time(0);
+            vector<TaskTracker> lapsed;
+            {
+                ScopedPhase phase(PHASE_LOOKUP);
+                store->scanUntil([](string_view status) { return status == "todo" || status == "in-progress"; },
+                                 [&](const TaskTracker& found) {
+                    if (found.status == "todo") {
+                        task = found;
+                        return false;
+                    }
+                    time_t expiry = leaseOf(found);
+                    if (expiry != -1 && expiry <= now) lapsed.push_back(found);
+                    return true;
+                });
+            }
+            for (size_t i = 0; i < lapsed.size(); i++) {
+                TaskTracker released = releaseTask(lapsed[i]);
+                if (i == 0) task = released;
+            }
+        }
+        if (task.getId() == 0) {
+            cout << "No todo tasks to claim" << endl;
+            return false;
+        }
+        
+        TaskTracker before = task;
+        task.updateStatus("in-progress", getCurrentTime());
+        task.setField("worker", worker);
+        task.setField("lease", lease > 0 ? formatTime(time(0) + lease) : "");
+        replaceTask(before, task);
+        saveTasks();
+        showTask(task);
+        return true;
+    }
+    
+    void setPriority(int id, int priority) {
+        TaskTracker task(id);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return;
+        }
+        TaskTracker before = task;
+        task.setField("priority", priority != 0 ? to_string(priority) : "");
+        task.updatedAt = getCurrentTime();
+        replaceTask(before, task);
+        saveTasks();
+        cout << "Task priority set to " << priority << endl;
+    }
+    
+    // Make id wait for dependency, unless that would close a cycle
+    void addDependency(int id, int dependency) {
+        TaskTracker task(id), other(dependency);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return;
+        }
+        if (!findTask(dependency, other)) {
+            cout << "Task with ID " << dependency << " not found" << endl;
+            return;
+        }
+        if (resident) indexAllDependencies();
+        // A dependency that waits for nothing cannot close a cycle
+        if (!other.dependencies().empty() && dependsOn(dependency, id)) {
+            cout << "Error: Task " << dependency << " already depends on task " << id
+                 << ", so this would create a cycle" << endl;
+            return;
+        }
+        vector<int> deps = task.dependencies();
+        if (find(deps.begin(), deps.end(), dependency) == deps.end()) {
+            string value = task.field("deps");
+            TaskTracker before = task;
+            task.setField("deps", (value.empty() ? "" : value + ",") + to_string(dependency));
+            task.updatedAt = getCurrentTime();
+            replaceTask(before, task);
+            saveTasks();
+        }
+        cout << "Task " << id << " now depends on task " << dependency << endl;
+    }
+    
+    // Show the todo tasks none of whose dependencies are still open. A
+    // resident manager reads its ready set; a one-shot command makes one
+    // pass noting the open tasks and the todo tasks' dependencies, then
+    // checks those against the open ones.
+    void listReadyTasks() {
+        if (!resident) {
+            unordered_set<int> open;
+            vector<pair<int, vector<int>>> todo;
+            {
+                ScopedPhase phase(PHASE_LOOKUP);
+                store->scan(nullptr, [&](const TaskTracker& task) {
+                    timings.tasksScanned++;
+                    if (task.status != "done") open.insert(task.getId());
+                    if (task.status == "todo") todo.emplace_back(task.getId(), task.dependencies());
+                });
+                sort(todo.begin(), todo.end());
+            }
+            bool found = false;
+            for (const auto& entry : todo) {
+                bool blocked = any_of(entry.second.begin(), entry.second.end(), [&](int dep) {
+                    return open.count(dep) > 0;
+                });
+                TaskTracker task(entry.first);
+                if (blocked || !findTask(entry.first, task)) continue;
+                showTask(task);
+                found = true;
+            }
+            if (!found) cout << "No ready tasks" << endl;
+            return;
+        }
+        indexAllDependencies();
+        for (int id : ready) {
+            TaskTracker task(id);
+            if (findTask(id, task)) showTask(task);
+        }
+        if (ready.empty()) cout << "No ready tasks" << endl;
+    }
+    
+    // Show the tasks as a tree of subtasks, or only the subtree under root,
+    // each parent with its stored progress. One pass links the tasks to
+    // their parents; the counts are never recomputed.
+    void listTaskTree(int root = 0) {
+        vector<pair<int, int>> links; // (id, parent)
+        {
+            ScopedPhase phase(PHASE_LOOKUP);
+            store->scan(nullptr, [&](const TaskTracker& task) {
+                timings.tasksScanned++;
+                links.emplace_back(task.getId(), task.parentId());
+            });
+            sort(links.begin(), links.end());
+        }
+        unordered_map<int, vector<int>> children;
+        vector<pair<int, int>> pending; // (id, depth), next on top
+        for (const auto& link : links) {
+            int parent = link.second;
+            bool linked = parent > 0 && parent < link.first &&
+                          binary_search(links.begin(), links.end(), make_pair(parent, 0),
+                                        [](const pair<int, int>& a, const pair<int, int>& b) {
+                                            return a.first < b.first;
+                                        });
+            if (linked) children[parent].push_back(link.first);
+            else if (root == 0) pending.emplace_back(link.first, 0);
+        }
+        if (root != 0) {
+            TaskTracker task(root);
+            if (!findTask(root, task)) {
+                cout << "Task with ID " << root << " not found" << endl;
+                return;
+            }
+            pending.emplace_back(root, 0);
+        }
+        if (pending.empty()) cout << "No tasks found" << endl;
+        reverse(pending.begin(), pending.end());
+        
+        while (!pending.empty()) {
+            int id = pending.back().first;
+            int depth = pending.back().second;
+            pending.pop_back();
+            auto below = children.find(id);
+            if (below != children.end()) {
+                for (auto child = below->second.rbegin(); child != below->second.rend(); ++child) {
+                    pending.emplace_back(*child, depth + 1);
+                }
+            }
+            
+            TaskTracker task(id);
+            if (!findTask(id, task)) continue;
+            ScopedPhase phase(PHASE_OUTPUT);
+            cout << string(depth * 2, ' ');
+            task.display();
+            timings.linesOutput++;
+        }
+    }
+    
+    // Add (or with on false, remove) tags on a task
+    void tagTask(int id, const vector<string>& tags, bool on) {
+        TaskTracker task(id);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return;
+        }
+        TaskTracker before = task;
+        bool modified = false;
+        for (const string& tag : tags) modified = task.setTag(tag, on) || modified;
+        if (modified) {
+            task.updatedAt = getCurrentTime();
+            replaceTask(before, task);
+            saveTasks();
+        }
+        cout << (on ? "Task tagged" : "Task untagged") << endl;
+    }
+    
+    // Show (or with countOnly, count) the tasks carrying every one of tags,
+    // and having status if not empty. A resident manager intersects their
+    // bitmaps, smallest first, so it costs no more than the rarest tag
+    // however many tasks there are; a one-shot command checks each task's
+    // tags in one pass.
+    void listTasksByTags(const vector<string>& tags, const string& status, bool countOnly) {
+        if (!resident) {
+            size_t count = 0;
+            auto matches = [&](const TaskTracker& task) {
+                timings.tasksScanned++;
+                vector<string> own = task.tags();
+                return all_of(tags.begin(), tags.end(), [&](const string& tag) {
+                    return find(own.begin(), own.end(), tag) != own.end();
+                });
+            };
+            auto visit = [&](const TaskTracker& task) {
+                if (matches(task)) {
+                    count++;
+                    if (!countOnly) showTask(task);
+                }
+            };
+            {
+                ScopedPhase phase(PHASE_LOOKUP);
+                if (status.empty()) store->scan(nullptr, visit);
+                else store->scanStatus(status, visit);
+            }
+            if (countOnly) cout << (status.empty() ? "total" : status) << ": " << count << endl;
+            else if (count == 0) cout << "No tasks found" << endl;
+            return;
+        }
+        if (!tagsIndexed) {
+            ScopedPhase phase(PHASE_LOOKUP);
+            store->scan(nullptr, [&](const TaskTracker& task) { indexTags(task.getId(), &task); });
+            tagsIndexed = true;
+        }
+        
+        static const RoaringBitmap none;
+        vector<const RoaringBitmap*> sets;
+        for (const string& tag : tags) {
+            auto bits = byTag.find(tag);
+            sets.push_back(bits != byTag.end() ? &bits->second : &none);
+        }
+        if (!status.empty()) {
+            auto bits = statusBits.find(status);
+            sets.push_back(bits != statusBits.end() ? &bits->second : &none);
+        }
+        sort(sets.begin(), sets.end(), [](const RoaringBitmap* a, const RoaringBitmap* b) {
+            return a->size() < b->size();
+        });
+        RoaringBitmap matching = *sets[0];
+        for (size_t i = 1; i < sets.size() && matching.size() > 0; i++) matching = matching & *sets[i];
+        
+        if (countOnly) {
+            cout << (status.empty() ? "total" : status) << ": " << matching.size() << endl;
+            return;
+        }
+        matching.forEach([&](uint32_t id) {
+            TaskTracker task((int)id);
+            if (findTask((int)id, task)) showTask(task);
+        });
+        if (matching.size() == 0) cout << "No tasks found" << endl;
+    }
+    
+    // Show the highest-priority task with status, the oldest among equals;
+    // false if there is none. A resident manager reads the top of that
+    // status's heap; a one-shot command keeps the best task of one pass
+    // over the tasks with status.
+    bool nextTask(const string& status) {
+        if (!resident) {
+            TaskTracker best(0);
+            {
+                ScopedPhase phase(PHASE_LOOKUP);
+                int bestPriority = 0;
+                store->scanStatus(status, [&](const TaskTracker& task) {
+                    timings.tasksScanned++;
+                    int priority = task.priority();
+                    if (best.getId() == 0 || priority > bestPriority ||
+                        (priority == bestPriority && task.getId() < best.getId())) {
+                        best = task;
+                        bestPriority = priority;
+                    }
+                });
+            }
+            if (best.getId() == 0) {
+                cout << "No " << status << " tasks" << endl;
+                return false;
+            }
+            showTask(best);
+            return true;
+        }
+        if (!prioritiesIndexed) {
+            ScopedPhase phase(PHASE_LOOKUP);
+            map<string, vector<pair<int, int>>> entries;
+            store->scan(nullptr, [&](const TaskTracker& task) {
+                entries[task.status].emplace_back(task.getId(), task.priority());
+            });
+            for (auto& status : entries) byPriority[status.first].build(move(status.second));
+            prioritiesIndexed = true;
+        }
+        auto heap = byPriority.find(status);
+        TaskTracker task(0);
+        if (heap == byPriority.end() || heap->second.empty() || !findTask(heap->second.top(), task)) {
+            cout << "No " << status << " tasks" << endl;
+            return false;
+        }
+        showTask(task);
+        return true;
+    }
+    
+    // Renew the lease on a claimed task for seconds (the configured default
+    // if negative). With a worker given, only the worker holding the claim
+    // may renew it.
+    bool heartbeat(int id, const string& worker, int seconds = -1) {
+        TaskTracker task(id);
+        if (!findTask(id, task)) {
+            cout << "Task with ID " << id << " not found" << endl;
+            return false;
+        }
+        if (task.status != "in-progress") {
+            cout << "Task with ID " << id << " is not in progress" << endl;
+            return false;
+        }
+        string holder = task.field("worker");
+        if (!worker.empty() && holder != worker) {
+            cout << "Error: Task " << id << " is claimed by " << (holder.empty() ? "no worker" : holder) << endl;
+            return false;
+        }
+        TaskTracker before = task;
+        string until = formatTime(time(0) + (seconds < 0 ? leaseSeconds : seconds));
+        task.setField("lease", until);
+        replaceTask(before, task);
+        saveTasks();
+        cout << "Lease on task " << id << " extended to " << until << endl;
+        return true;
+    }
+    
+    void listAllTasks(bool includeArchive = false) {
+        bool found = includeArchive && showArchived([](const TaskTracker&) { return true; });
+        found = showTasks(nullptr) || found;
+        if (!found) {
+            cout << "No tasks found" << endl;
+        }
+    }
+    
+    void listTasksByStatus(string status, bool includeArchive = false) {
+        auto matches = [&](const TaskTracker& task) { return task.status == status; };
+        bool found = includeArchive && showArchived(matches);
+        {
+            ScopedPhase phase(PHASE_LOOKUP);
+            store->scanStatus(status, [&](const TaskTracker& task) {
+                showTask(task);
+                found = true;
+            });
+        }
+        if (!found) {
+            cout << "No tasks found with status: " << status << endl;
+        }
+    }
+    
+    // Print the number of tasks per status and in total, or only the count
+    // for one status. Only statuses are read, not descriptions.
+    void countTasks(const string& status) {
+        map<string, size_t> counts;
+        {
+            ScopedPhase phase(PHASE_LOOKUP);
+            store->countByStatus(counts);
+        }
+        if (!status.empty()) {
+            cout << status << ": " << counts[status] << endl;
+            return;
+        }
+        size_t total = 0;
+        for (const auto& entry : counts) {
+            cout << entry.first << ": " << entry.second << endl;
+            total += entry.second;
+        }
+        cout << "total: " << total << endl;
+    }
+    
+    // List tasks, archived ones included, whose description contains text
+    // (case-insensitive)
+    void searchTasks(string text) {
+        auto lower = [](string str) {
+            transform(str.begin(), str.end(), str.begin(), ::tolower);
+            return str;
+        };
+        string needle = lower(text);
+        auto matches = [&](const TaskTracker& task) {
+            return lower(task.desc).find(needle) != string::npos;
+        };
+        
+        bool found = showArchived(matches);
+        found = showTasks(matches) || found;
+        if (!found) {
+            cout << "No tasks found matching: " << text << endl;
+        }
+    }
+    
+    // Archive done tasks not updated for the given number of days now
+    void archiveTasks(int days) {
+        size_t moved = archiveDoneTasks(time(0) - (time_t)days * 86400);
+        saveTasks();
+        cout << "Archived " << moved << " done tasks into " << archive.dir << endl;
+    }
+    
+    // List tasks whose createdAt (or updatedAt) falls in [from, to], oldest
+    // first. A resident manager answers from its time indexes; a one-shot
+    // command makes one pass comparing clock keys and sorts only the matches.
+    void listTasksByTime(bool byUpdated, time_t from, time_t to) {
+        ScopedPhase phase(PHASE_LOOKUP);
+        int64_t lo = clockKey(from), hi = clockKey(to);
+        bool found = false;
+        
+        if (resident) {
+            if (!timeIndexed) buildTimeIndex();
+            const TimeIndex& index = byUpdated ? updatedIndex : createdIndex;
+            index.range(lo, hi, [&](size_t id) {
+                TaskTracker task((int)id);
+                if (store->get((int)id, task)) {
+                    showTask(task);
+                    found = true;
+                }
+            });
+        }
+        else {
+            vector<pair<int64_t, TaskTracker>> matches;
+            store->scan([&](const TaskTracker& task) {
+                timings.tasksScanned++;
+                int64_t key = clockKey(byUpdated ? task.updatedAt : task.createdAt);
+                return key != -1 && key >= lo && key <= hi;
+            }, [&](const TaskTracker& task) {
+                matches.emplace_back(clockKey(byUpdated ? task.updatedAt : task.createdAt), task);
+            });
+            stable_sort(matches.begin(), matches.end(), [](const auto& a, const auto& b) {
+                return a.first < b.first;
+            });
+            for (const auto& match : matches) showTask(match.second);
+            found = !matches.empty();
+        }
+        if (!found) {
+            cout << "No tasks found in that time range" << endl;
+        }
+    }
+};
+
+void printUsage() {
+    cout << "Usage:" << endl;
+    cout << "  task-cli add \"description\" [--priority n] [--tag tag]... [--parent id]" << endl;
+    cout << "                                     - Add a new task, a subtask of id if given" << endl;
+    cout << "  task-cli update <id> \"description\" - Update task description" << endl;
+    cout << "  task-cli delete <id>               - Delete a task" << endl;
+    cout << "  task-cli mark-in-progress <id>     - Mark task as in progress" << endl;
+    cout << "  task-cli mark-done <id>            - Mark task as done" << endl;
+    cout << "  task-cli claim [--worker name] [--lease seconds]" << endl;
+    cout << "                                     - Mark the oldest todo task in progress and show it" << endl;
+    cout << "  task-cli heartbeat <id> [seconds] [--worker name]" << endl;
+    cout << "                                     - Renew the lease on a claimed task, for worker if given" << endl;
+    cout << "  task-cli priority <id> <n>         - Set a task's priority (default 0, higher first)" << endl;
+    cout << "  task-cli tag <id> <tag>...         - Label a task (no commas, quotes or backslashes)" << endl;
+    cout << "  task-cli untag <id> <tag>...       - Remove labels from a task" << endl;
+    cout << "  task-cli depend <id> on <id>       - Make the first task wait until the second is done" << endl;
+    cout << "  task-cli next [--status status]    - Show the highest-priority, oldest todo (or status) task" << endl;
+    cout << "  task-cli list                      - List all tasks" << endl;
+    cout << "  task-cli list done                 - List completed tasks" << endl;
+    cout << "  task-cli list todo                 - List todo tasks" << endl;
+    cout << "  task-cli list in-progress          - List in-progress tasks" << endl;
+    cout << "  task-cli list --updated-since <t>  - List tasks updated since a time" << endl;
+    cout << "  task-cli list --created-since <t>  - List tasks created since a time" << endl;
+    cout << "  task-cli list --updated-between <from> <to>" << endl;
+    cout << "  task-cli list --created-between <from> <to>" << endl;
+    cout << "                                     - List tasks in a time range" << endl;
+    cout << "  task-cli list --all [status]       - Include archived tasks" << endl;
+    cout << "  task-cli list --tag <tag> [--tag <tag>]... [--status status]" << endl;
+    cout << "                                     - List tasks carrying all the tags" << endl;
+    cout << "  task-cli list --ready              - List todo tasks whose dependencies are all done" << endl;
+    cout << "  task-cli list --tree [id]          - List tasks (or id and its subtasks) as a tree with progress" << endl;
+    cout << "  task-cli count [status]            - Count tasks per status" << endl;
+    cout << "  task-cli count --tag <tag>... [--status status] - Count tasks carrying all the tags" << endl;
+    cout << "  task-cli search \"text\"             - Search descriptions, archive included" << endl;
+    cout << "  task-cli query [--all] '<expr>'    - List tasks matching e.g. 'status=todo and updated<7d and desc~\"deploy\"'" << endl;
+    cout << "                                       Fields: id status desc created updated priority tag <field>;" << endl;
+    cout << "                                       = != ~ (contains) < <= > >=, and/or/not, parentheses" << endl;
+    cout << "  task-cli archive [days]            - Archive done tasks older than days (default 30)" << endl;
+    cout << "  task-cli export [status]           - Write tasks to stdout as NDJSON" << endl;
+    cout << "  task-cli serve [window-us] [batch] - Serve tasks on tasks.sock; other commands forward to it" << endl;
+    cout << "  task-cli storage [kind] [size]     - Show or change the storage engine:" << endl;
+    cout << "                                       json, ndjson, sharded (shard size), records or btree" << endl;
+    cout << "  task-cli format json|ndjson|records - Same as storage json|ndjson|records" << endl;
+    cout << "  task-cli shard [size]              - Same as storage sharded [size] (default 10000)" << endl;
+    cout << "  task-cli unshard                   - Same as storage json" << endl;
+    cout << "  Times: 30m, 1h, 7d, 2w (ago), 2024-05-01[ 13:30], @<epoch>" << endl;
+    cout << "  Add --timings (or set TASK_TIMINGS=1) for a per-phase timing report on stderr" << endl;
+    cout << "  Add --stats (or set TASK_STATS=1) to also count allocations and syscalls" << endl;
+}
+
+// bench.cpp and other tools include this file with TATRA_NO_MAIN defined
+#ifndef TATRA_NO_MAIN
+int runCommand(int argc, char* argv[], TaskManager* resident = nullptr);
+
+// Clients find the server through this socket in the working directory
+const char* SERVER_SOCKET = "tasks.sock";
+
+// Exclusive lock on a file, held until destroyed (see runCommand)
+class FileLock {
+private:
+    int fd;
+    
+public:
+    explicit FileLock(const string& path) {
+        fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        while (fd >= 0 && flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+    }
+    
+    ~FileLock() {
+        if (fd >= 0) close(fd);
+    }
+};
+
+// One task as the read-only views hand it out (see answerReadOnly)
+struct TaskRow {
+    int id;
+    string_view desc;
+    string_view status;
+    string_view createdAt;
+    string_view updatedAt;
+    string_view extra;
+};
+
+// Same format as TaskTracker::display
+void showRow(ostream& out, const TaskRow& row) {
+    out << "ID: " << row.id << " | " << row.desc << " | Status: " << row.status
+        << " | Created: " << row.createdAt << " | Updated: " << row.updatedAt;
+    if (!row.extra.empty()) out << TaskTracker::fieldsText(row.extra);
+    out << '\n';
+}
+
+// Show the rows of view (archived ones first if asked) passing filter;
+// false if there were none
+template <typename View, typename F>
+bool showRows(const View& view, ostream& out, bool includeArchive, F filter) {
+    bool found = false;
+    auto show = [&](const TaskRow& row) {
+        if (filter(row)) {
+            showRow(out, row);
+            found = true;
+        }
+    };
+    if (includeArchive) {
+        string dir = view.archiveDir();
+        for (const string& segment : view.segments()) {
+            string content;
+            if (!readFile(dir + "/" + segment, content)) continue;
+            parseTasks(content, [&](TaskTracker&& task) {
+                show({task.getId(), task.desc, task.status, task.createdAt, task.updatedAt, task.extra});
+            });
+        }
+    }
+    view.forEach(show);
+    return found;
+}
+
+// A filter such as
+//   status=todo and updated<7d and (desc~"deploy" or tag=infra)
+// parsed once into a predicate tree and compiled to a flat bytecode, so a
+// row costs one pass over a few instructions: no virtual calls, nothing
+// left to parse in the query, and times compared as integers. Fields are
+// id, status, desc, created, updated, priority, tag, and any optional
+// field by name (worker, parent...). = and != work on all of them; ~ is a
+// case-insensitive "contains"; < <= > >= compare numbers and times. A time
+// is absolute (2024-05-01, "2024-05-01 13:30", @epoch) or an age (30m, 7d),
+// so updated<7d means updated less than 7 days ago.
+class TaskQuery {
+private:
+    enum Op : uint8_t {
+        STATUS_EQ, STATUS_CONTAINS, DESC_EQ, DESC_CONTAINS,
+        FIELD_EQ, FIELD_CONTAINS, FIELD_CMP, TAG_HAS,
+        ID_CMP, PRIORITY_CMP, CREATED_CMP, UPDATED_CMP,
+        NOT, JUMP_IF_FALSE, JUMP_IF_TRUE
+    };
+    enum Cmp : uint8_t { LT, LE, GT, GE, EQ, NE };
+    
+    struct Instruction {
+        Op op;
+        Cmp cmp;
+        int64_t number; // Operand, or jump target
+        string text;    // Operand, lowercased for the contains ops
+        string name;    // Optional field name
+    };
+    
+    // Parsed form: a comparison, or and/or/not over children
+    struct Node {
+        enum Kind { TEST, AND, OR, NOT } kind;
+        Instruction test;
+        vector<Node> children;
+    };
+    
+    vector<Instruction> code;
+    char folded[256];
+    
+    // The parser's position in the query text
+    const char* pos;
+    const char* end;
+    time_t now;
+    string error;
+    
+    static int64_t toNumber(string_view s) {
+        bool negative = !s.empty() && s[0] == '-';
+        int64_t value = 0;
+        for (size_t i = negative ? 1 : 0; i < s.size() && isdigit((unsigned char)s[i]); i++) {
+            value = value * 10 + (s[i] - '0');
+        }
+        return negative ? -value : value;
+    }
+    
+    // Whether a time value is an age like 30m or 7d rather than a point
+    static bool isAge(const string& value) {
+        size_t digits = 0;
+        while (digits < value.size() && isdigit((unsigned char)value[digits])) digits++;
+        return digits > 0 && digits + 1 == value.size() && strchr("smhdw", value.back());
+    }
+    
+    static string_view fieldOf(string_view extra, string_view name) {
+        string_view found;
+        TaskTracker::forEachField(extra, [&](string_view n, string_view v) {
+            if (n == name) found = v;
+        });
+        return found;
+    }
+    
+    static bool compare(int64_t a, Cmp cmp, int64_t b) {
+        switch (cmp) {
+            case LT: return a < b;
+            case LE: return a <= b;
+            case GT: return a > b;
+            case GE: return a >= b;
+            case EQ: return a == b;
+            case NE: return a != b;
+        }
+        return false;
+    }
+    
+    bool contains(string_view haystack, const string& needle) const {
+        return search(haystack.begin(), haystack.end(), needle.begin(), needle.end(),
+                      [&](char c, char n) { return folded[(unsigned char)c] == n; }) != haystack.end();
+    }
+    
+    static bool hasTag(string_view tags, string_view tag) {
+        size_t start = 0;
+        while (start <= tags.size()) {
+            size_t comma = tags.find(',', start);
+            if (comma == string_view::npos) comma = tags.size();
+            if (tags.substr(start, comma - start) == tag) return true;
+            start = comma + 1;
+        }
+        return false;
+    }
+    
+    // Tokens: words, quoted strings, operators and parentheses
+    void skipSpace() {
+        while (pos < end && isspace((unsigned char)*pos)) pos++;
+    }
+    
+    bool fail(const string& message) {
+        if (error.empty()) error = message;
+        return false;
+    }
+    
+    bool keyword(const char* word) {
+        skipSpace();
+        size_t length = strlen(word);
+        if ((size_t)(end - pos) < length || strncasecmp(pos, word, length) != 0) return false;
+        if (pos + length < end && !isspace((unsigned char)pos[length]) && pos[length] != '(') return false;
+        pos += length;
+        return true;
+    }
+    
+    bool word(string& out) {
+        skipSpace();
+        out.clear();
+        if (pos < end && *pos == '"') {
+            for (pos++; pos < end && *pos != '"'; pos++) {
+                if (*pos == '\\' && pos + 1 < end) pos++;
+                out += *pos;
+            }
+            if (pos == end) return fail("Unterminated string");
+            pos++;
+            return true;
+        }
+        while (pos < end && !isspace((unsigned char)*pos) && !strchr("()<>=!~\"", *pos)) out += *pos++;
+        return !out.empty();
+    }
+    
+    bool comparison(Cmp& cmp, bool& like) {
+        skipSpace();
+        like = false;
+        if (pos < end && *pos == '~') { like = true; pos++; return true; }
+        static const pair<const char*, Cmp> ops[] = {
+            {"!=", NE}, {"<=", LE}, {">=", GE}, {"=", EQ}, {"<", LT}, {">", GT}
+        };
+        for (const auto& op : ops) {
+            size_t length = strlen(op.first);
+            if ((size_t)(end - pos) >= length && strncmp(pos, op.first, length) == 0) {
+                pos += length;
+                cmp = op.second;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    bool parseTest(Node& node) {
+        string field, value;
+        Cmp cmp = EQ;
+        bool like;
+        if (!word(field)) return fail("Expected a field name");
+        if (!comparison(cmp, like)) return fail("Expected =, !=, <, <=, >, >= or ~ after " + field);
+        if (!word(value)) return fail("Expected a value after " + field);
+        
+        node.kind = Node::TEST;
+        Instruction& test = node.test;
+        test.cmp = cmp;
+        test.number = 0;
+        bool equality = like || cmp == EQ || cmp == NE;
+        string lowered = value;
+        transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+        
+        if (field == "id" || field == "priority") {
+            if (like) return fail("~ does not apply to " + field);
+            test.op = field == "id" ? ID_CMP : PRIORITY_CMP;
+            test.number = toNumber(value);
+            return true;
+        }
+        if (field == "created" || field == "updated") {
+            if (like) return fail("~ does not apply to " + field);
+            time_t t;
+            if (!parseTimeArg(value, now, t)) return fail("Invalid time: " + value);
+            // An age turns the comparison around: updated<7d is after 7d ago
+            if (isAge(value)) {
+                static const Cmp flipped[] = { GT, GE, LT, LE, EQ, NE };
+                test.cmp = flipped[cmp];
+            }
+            test.op = field == "created" ? CREATED_CMP : UPDATED_CMP;
+            test.number = clockKey(t);
+            return true;
+        }
+        if (!equality) {
+            if (field == "status" || field == "desc" || field == "description" || field == "tag" || field == "tags") {
+                return fail("< and > do not apply to " + field);
+            }
+            test.op = FIELD_CMP;
+            test.name = field;
+            test.number = toNumber(value);
+            return true;
+        }
+        
+        if (field == "status") test.op = like ? STATUS_CONTAINS : STATUS_EQ;
+        else if (field == "desc" || field == "description") test.op = like ? DESC_CONTAINS : DESC_EQ;
+        else if (field == "tag" || field == "tags") {
+            test.op = like ? FIELD_CONTAINS : TAG_HAS;
+            test.name = "tags";
+        }
+        else {
+            test.op = like ? FIELD_CONTAINS : FIELD_EQ;
+            test.name = field;
+        }
+        test.text = like ? lowered : value;
+        if (cmp == NE) {
+            Node positive = node;
+            node.kind = Node::NOT;
+            node.children.assign(1, positive);
+        }
+        return true;
+    }
+    
+    bool parseFactor(Node& node) {
+        if (keyword("not")) {
+            node.kind = Node::NOT;
+            node.children.resize(1);
+            return parseFactor(node.children[0]);
+        }
+        skipSpace();
+        if (pos < end && *pos == '(') {
+            pos++;
+            if (!parseOr(node)) return false;
+            skipSpace();
+            if (pos == end || *pos != ')') return fail("Expected )");
+            pos++;
+            return true;
+        }
+        return parseTest(node);
+    }
+    
+    // and binds tighter than or
+    bool parseAnd(Node& node) {
+        Node first;
+        if (!parseFactor(first)) return false;
+        if (!keyword("and")) {
+            node = move(first);
+            return true;
+        }
+        node.kind = Node::AND;
+        node.children.push_back(move(first));
+        do {
+            node.children.emplace_back();
+            if (!parseFactor(node.children.back())) return false;
+        } while (keyword("and"));
+        return true;
+    }
+    
+    bool parseOr(Node& node) {
+        Node first;
+        if (!parseAnd(first)) return false;
+        if (!keyword("or")) {
+            node = move(first);
+            return true;
+        }
+        node.kind = Node::OR;
+        node.children.push_back(move(first));
+        do {
+            node.children.emplace_back();
+            if (!parseAnd(node.children.back())) return false;
+        } while (keyword("or"));
+        return true;
+    }
+    
+    // and/or evaluate their children in turn and jump to the end as soon
+    // as the result is known
+    void emit(const Node& node) {
+        if (node.kind == Node::TEST) {
+            code.push_back(node.test);
+            return;
+        }
+        if (node.kind == Node::NOT) {
+            emit(node.children[0]);
+            code.push_back({NOT, EQ, 0, "", ""});
+            return;
+        }
+        vector<size_t> jumps;
+        for (size_t i = 0; i < node.children.size(); i++) {
+            emit(node.children[i]);
+            if (i + 1 == node.children.size()) break;
+            jumps.push_back(code.size());
+            code.push_back({node.kind == Node::AND ? JUMP_IF_FALSE : JUMP_IF_TRUE, EQ, 0, "", ""});
+        }
+        for (size_t jump : jumps) code[jump].number = (int64_t)code.size();
+    }
+    
+public:
+    // Parse and compile text; on failure returns false and sets message
+    bool compile(const string& text, time_t at, string& message) {
+        for (int c = 0; c < 256; c++) folded[c] = (char)::tolower(c);
+        pos = text.data();
+        end = text.data() + text.size();
+        now = at;
+        error.clear();
+        code.clear();
+        
+        Node root;
+        if (parseOr(root)) {
+            skipSpace();
+            if (pos == end) {
+                emit(root);
+                return true;
+            }
+            fail("Unexpected " + string(pos, end));
+        }
+        message = error;
+        return false;
+    }
+    
+    bool matches(const TaskRow& row) const {
+        bool result = true;
+        const Instruction* program = code.data();
+        for (size_t pc = 0; pc < code.size(); pc++) {
+            const Instruction& in = program[pc];
+            switch (in.op) {
+                case STATUS_EQ: result = row.status == in.text; break;
+                case STATUS_CONTAINS: result = contains(row.status, in.text); break;
+                case DESC_EQ: result = row.desc == in.text; break;
+                case DESC_CONTAINS: result = contains(row.desc, in.text); break;
+                case FIELD_EQ: result = fieldOf(row.extra, in.name) == in.text; break;
+                case FIELD_CONTAINS: result = contains(fieldOf(row.extra, in.name), in.text); break;
+                case TAG_HAS: result = hasTag(fieldOf(row.extra, "tags"), in.text); break;
+                case FIELD_CMP: {
+                    string_view value = fieldOf(row.extra, in.name);
+                    result = !value.empty() && compare(toNumber(value), in.cmp, in.number);
+                    break;
+                }
+                case ID_CMP: result = compare(row.id, in.cmp, in.number); break;
+                case PRIORITY_CMP: result = compare(toNumber(fieldOf(row.extra, "priority")), in.cmp, in.number); break;
+                case CREATED_CMP: {
+                    int64_t key = clockKey(row.createdAt);
+                    result = key != -1 && compare(key, in.cmp, in.number);
+                    break;
+                }
+                case UPDATED_CMP: {
+                    int64_t key = clockKey(row.updatedAt);
+                    result = key != -1 && compare(key, in.cmp, in.number);
+                    break;
+                }
+                case NOT: result = !result; break;
+                case JUMP_IF_FALSE: if (!result) pc = (size_t)in.number - 1; break;
+                case JUMP_IF_TRUE: if (result) pc = (size_t)in.number - 1; break;
+            }
+        }
+        return result;
+    }
+};
+
+// Answer "query [--all] <expression>" from view (see answerReadOnly)
+template <typename View>
+int answerQuery(const View& view, const vector<string>& args, ostream& out) {
+    vector<string> rest(args.begin() + 2, args.end());
+    auto all = find(rest.begin(), rest.end(), "--all");
+    bool includeArchive = all != rest.end();
+    if (includeArchive) rest.erase(all);
+    
+    string text;
+    for (const string& part : rest) text += (text.empty() ? "" : " ") + part;
+    TaskQuery query;
+    string error;
+    if (text.empty()) error = "Please provide a query, e.g. 'status=todo and updated<7d'";
+    if (!error.empty() || !query.compile(text, time(0), error)) {
+        out << "Error: " << error << '\n';
+        return 1;
+    }
+    bool found = showRows(view, out, includeArchive, [&](const TaskRow& row) { return query.matches(row); });
+    if (!found) out << "No tasks found" << '\n';
+    return 0;
+}
+
+// Answer a plain list, count, search or query from a read-only view of the tasks
+// exactly as TaskManager would; -1 if args is any other command. A View
+// provides forEach(F) over TaskRows in id order, forEachCount(F) over
+// (status, count) in status order, archiveDir() and segments().
+template <typename View>
+int answerReadOnly(const View& view, const vector<string>& args, ostream& out) {
+    if (args.size() < 2) return -1;
+    const string& command = args[1];
+    vector<string> rest(args.begin() + 2, args.end());
+    
+    if (command == "count") {
+        if (!rest.empty() && rest[0].rfind("--", 0) == 0) return -1;
+        string status = rest.empty() ? "" : rest[0];
+        size_t total = 0, matching = 0;
+        view.forEachCount([&](string_view name, size_t count) {
+            if (status.empty()) out << name << ": " << count << '\n';
+            else if (name == status) matching = count;
+            total += count;
+        });
+        if (status.empty()) out << "total: " << total << '\n';
+        else out << status << ": " << matching << '\n';
+        return 0;
+    }
+    if (command == "search" && !rest.empty()) {
+        auto lower = [](string str) {
+            transform(str.begin(), str.end(), str.begin(), ::tolower);
+            return str;
+        };
+        string needle = lower(rest[0]);
+        char folded[256];
+        for (int c = 0; c < 256; c++) folded[c] = (char)::tolower(c);
+        bool found = showRows(view, out, true, [&](const TaskRow& row) {
+            return search(row.desc.begin(), row.desc.end(), needle.begin(), needle.end(),
+                          [&](char c, char n) { return folded[(unsigned char)c] == n; }) != row.desc.end();
+        });
+        if (!found) out << "No tasks found matching: " << rest[0] << '\n';
+        return 0;
+    }
+    if (command == "query") return answerQuery(view, args, out);
+    if (command != "list") return -1;
+    
+    auto all = find(rest.begin(), rest.end(), "--all");
+    bool includeArchive = all != rest.end();
+    if (includeArchive) rest.erase(all);
+    if (rest.size() > 1 || (rest.size() == 1 && rest[0].rfind("--", 0) == 0)) return -1;
+    string status = rest.empty() ? "" : rest[0];
+    bool found = showRows(view, out, includeArchive, [&](const TaskRow& row) {
+        return status.empty() || row.status == status;
+    });
+    if (!found && status.empty()) out << "No tasks found" << '\n';
+    else if (!found) out << "No tasks found with status: " << status << '\n';
+    return 0;
+}
+
+// One immutable version of the live tasks, ordered by id, that server
+// threads read without locks while the applier moves on (see SnapshotStore).
+// Tasks sit in chunks shared between versions, so the next version copies
+// only the chunks a batch touched. Archived segments are never rewritten,
+// so listing their names is enough.
+class TaskSnapshot {
+private:
+    typedef vector<TaskTracker> Chunk;
+    static const size_t CHUNK_TASKS = 1024;
+    
+    vector<shared_ptr<Chunk>> chunks;
+    vector<int> firstIds;
+    vector<bool> owned; // Chunks copied for this version while it is built
+    map<string, size_t> counts;
+    string archivePath;
+    vector<string> segmentNames;
+    
+    friend class SnapshotStore;
+    mutable uint64_t retiredAt = 0; // Epoch when replaced
+    
+public:
+    uint64_t version = 1; // Counts the batches applied since the server started
+    
+    // The first version, from every live task in any order
+    TaskSnapshot(vector<TaskTracker> tasks, const ArchiveStore& archive) {
+        sort(tasks.begin(), tasks.end(), [](const TaskTracker& a, const TaskTracker& b) {
+            return a.getId() < b.getId();
+        });
+        for (size_t i = 0; i < tasks.size(); i += CHUNK_TASKS) {
+            auto end = tasks.begin() + min(tasks.size(), i + CHUNK_TASKS);
+            chunks.push_back(make_shared<Chunk>(make_move_iterator(tasks.begin() + i),
+                                                make_move_iterator(end)));
+            firstIds.push_back(chunks.back()->front().getId());
+        }
+        for (const auto& chunk : chunks) {
+            for (const TaskTracker& task : *chunk) counts[task.status]++;
+        }
+        setArchive(archive);
+    }
+    
+    // The next version, sharing every chunk with this one until changed
+    TaskSnapshot* edit() const {
+        TaskSnapshot* next = new TaskSnapshot(*this);
+        next->owned.assign(chunks.size(), false);
+        next->retiredAt = 0;
+        next->version = version + 1;
+        return next;
+    }
+    
+    void setArchive(const ArchiveStore& archive) {
+        archivePath = archive.dir;
+        segmentNames.clear();
+        for (const auto& segment : archive.segments) segmentNames.push_back(segment.name);
+    }
+    
+    // Store task under id, or remove the task with that id (task == nullptr)
+    void apply(int id, const TaskTracker* task) {
+        if (chunks.empty()) {
+            if (task == nullptr) return;
+            chunks.push_back(make_shared<Chunk>());
+            firstIds.push_back(id);
+            owned.push_back(true);
+        }
+        size_t c = upper_bound(firstIds.begin(), firstIds.end(), id) - firstIds.begin();
+        c = c == 0 ? 0 : c - 1;
+        if (!owned[c]) {
+            chunks[c] = make_shared<Chunk>(*chunks[c]);
+            owned[c] = true;
+        }
+        
+        Chunk& chunk = *chunks[c];
+        auto it = lower_bound(chunk.begin(), chunk.end(), id, [](const TaskTracker& t, int id) {
+            return t.getId() < id;
+        });
+        bool found = it != chunk.end() && it->getId() == id;
+        if (found && --counts[it->status] == 0) counts.erase(it->status);
+        if (task != nullptr) {
+            counts[task->status]++;
+            if (found) *it = *task;
+            else chunk.insert(it, *task);
+        }
+        else if (found) {
+            chunk.erase(it);
+        }
+        
+        if (chunk.empty()) {
+            chunks.erase(chunks.begin() + c);
+            firstIds.erase(firstIds.begin() + c);
+            owned.erase(owned.begin() + c);
+            return;
+        }
+        firstIds[c] = chunk.front().getId();
+        if (chunk.size() >= 2 * CHUNK_TASKS) {
+            auto half = make_shared<Chunk>(make_move_iterator(chunk.begin() + CHUNK_TASKS),
+                                           make_move_iterator(chunk.end()));
+            chunk.erase(chunk.begin() + CHUNK_TASKS, chunk.end());
+            chunks.insert(chunks.begin() + c + 1, half);
+            firstIds.insert(firstIds.begin() + c + 1, half->front().getId());
+            owned.insert(owned.begin() + c + 1, true);
+        }
+    }
+    
+    // The read-only view for answerReadOnly
+    template <typename F>
+    void forEach(F visit) const {
+        for (const auto& chunk : chunks) {
+            for (const TaskTracker& task : *chunk) {
+                visit(TaskRow{task.getId(), task.desc, task.status, task.createdAt,
+                              task.updatedAt, task.extra});
+            }
+        }
+    }
+    
+    template <typename F>
+    void forEachCount(F visit) const {
+        for (const auto& entry : counts) visit(string_view(entry.first), entry.second);
+    }
+    
+    const string& archiveDir() const {
+        return archivePath;
+    }
+    
+    const vector<string>& segments() const {
+        return segmentNames;
+    }
+};
+
+// Publishes TaskSnapshot versions from one writer to any number of readers.
+// Readers take no lock: they pin the current epoch in a slot, then load the
+// current version. The writer swaps in the next version, retires the old one
+// at the epoch it ends, and frees retired versions once no reader is pinned
+// at or before that epoch.
+class SnapshotStore {
+private:
+    static const size_t READER_SLOTS = 64;
+    
+    atomic<const TaskSnapshot*> current{nullptr};
+    atomic<uint64_t> epoch{1};
+    atomic<uint64_t> pinned[READER_SLOTS] = {}; // 0 when the slot is free
+    vector<const TaskSnapshot*> retired;        // Writer only
+    
+    void reclaim() {
+        uint64_t oldest = numeric_limits<uint64_t>::max();
+        for (const auto& slot : pinned) {
+            uint64_t e = slot.load();
+            if (e != 0) oldest = min(oldest, e);
+        }
+        auto kept = remove_if(retired.begin(), retired.end(), [&](const TaskSnapshot* old) {
+            if (old->retiredAt >= oldest) return false;
+            delete old;
+            return true;
+        });
+        retired.erase(kept, retired.end());
+    }
+    
+public:
+    ~SnapshotStore() {
+        for (const TaskSnapshot* old : retired) delete old;
+        delete current.load();
+    }
+    
+    // Keeps the version it read alive until destroyed
+    class Reader {
+    private:
+        SnapshotStore& store;
+        size_t slot = 0;
+        const TaskSnapshot* version;
+        
+    public:
+        explicit Reader(SnapshotStore& snapshots) : store(snapshots) {
+            for (uint64_t expected = 0;; slot = (slot + 1) % READER_SLOTS, expected = 0) {
+                if (store.pinned[slot].compare_exchange_weak(expected, store.epoch.load())) break;
+                if (slot == READER_SLOTS - 1) this_thread::yield();
+            }
+            version = store.current.load();
+        }
+        
+        ~Reader() {
+            store.pinned[slot].store(0);
+        }
+        
+        const TaskSnapshot& operator*() const {
+            return *version;
+        }
+        
+        const TaskSnapshot* operator->() const {
+            return version;
+        }
+    };
+    
+    const TaskSnapshot* latest() const {
+        return current.load();
+    }
+    
+    // Writer only: make next the current version
+    void publish(const TaskSnapshot* next) {
+        const TaskSnapshot* old = current.exchange(next);
+        if (old != nullptr) {
+            old->retiredAt = epoch.fetch_add(1);
+            retired.push_back(old);
+        }
+        reclaim();
+    }
+};
+
+// The live tasks published by the server in POSIX shared memory, so that
+// plain list, count and search are answered by mapping them: no socket
+// round trip and no parsing. A small header object holds a seqlock over the
+// version the server has committed, the version last published and the
+// generation of the object holding it. Every published version is a new
+// immutable object "<name>.<generation>" of columns plus a string heap; the
+// previous one is unlinked at the next publish, which never disturbs a
+// reader that still has it mapped. Readers use the data only while it is
+// current and the server is alive; otherwise the command goes to the server.
+class SharedIndex {
+private:
+    struct Header {
+        char magic[8];
+        atomic<uint64_t> seq; // Odd while the fields below are being written
+        atomic<uint64_t> pid;
+        atomic<uint64_t> version;
+        atomic<uint64_t> published;
+        atomic<uint64_t> generation;
+    };
+    
+    // Followed by uint64 counts[statuses], uint64 offsets[strings + 1],
+    // int32 ids[tasks], uint8 statusOf[tasks] and the string heap. Strings
+    // TASK_STRINGS * i + 0..3 are task i's description, createdAt,
+    // updatedAt and optional fields; then come the status names, the
+    // archive directory and the segment names.
+    struct DataHeader {
+        char magic[8];
+        uint64_t version;
+        uint64_t tasks;
+        uint64_t statuses;
+        uint64_t segments;
+        uint64_t size;
+    };
+    
+    static const uint64_t TASK_STRINGS = 4;
+    
+    string name;
+    int headerFd = -1;
+    Header* header = nullptr;
+    
+    // Writer
+    mutex writing;
+    uint64_t generation = 0;
+    
+    // Reader
+    char* data = nullptr;
+    size_t length = 0;
+    const uint64_t* counts = nullptr;
+    const uint64_t* offsets = nullptr;
+    const int32_t* ids = nullptr;
+    const uint8_t* statusOf = nullptr;
+    const char* heap = nullptr;
+    const DataHeader* info = nullptr;
+    
+    string dataName(uint64_t gen) const {
+        return name + "." + to_string(gen);
+    }
+    
+    string_view text(uint64_t k) const {
+        return string_view(heap + offsets[k], offsets[k + 1] - offsets[k]);
+    }
+    
+    template <typename F>
+    void update(F write) {
+        uint64_t seq = header->seq.load(memory_order_relaxed);
+        header->seq.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        write();
+        header->seq.store(seq + 2, memory_order_release);
+    }
+    
+public:
+    // The shared memory name for the tasks file in the working directory
+    explicit SharedIndex(const string& file) {
+        char cwd[4096];
+        string path = (getcwd(cwd, sizeof(cwd)) != nullptr ? string(cwd) : string(".")) + "/" + file;
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hashContent(path));
+        name = string("/tatra-") + hex;
+    }
+    
+    ~SharedIndex() {
+        if (data != nullptr) munmap(data, length);
+        if (header != nullptr) munmap(header, sizeof(Header));
+        if (headerFd >= 0) ::close(headerFd);
+    }
+    
+    // Server: create the header, replacing one left by a server that died
+    bool create() {
+        shm_unlink(name.c_str());
+        headerFd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (headerFd < 0 || ftruncate(headerFd, sizeof(Header)) != 0) return false;
+        void* p = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, headerFd, 0);
+        if (p == MAP_FAILED) return false;
+        header = (Header*)p;
+        memcpy(header->magic, "TTSHMI1", 8);
+        header->pid.store((uint64_t)getpid());
+        return true;
+    }
+    
+    // Server: version has been committed; readers wait for its publication
+    void announce(uint64_t version) {
+        lock_guard<mutex> guard(writing);
+        update([&]() { header->version.store(version, memory_order_relaxed); });
+    }
+    
+    // Server: write snapshot into a new object and make it current. Fails
+    // (leaving readers on the server) with more than 256 distinct statuses.
+    bool publish(const TaskSnapshot& snapshot) {
+        vector<string_view> statuses;
+        snapshot.forEachCount([&](string_view status, size_t) { statuses.push_back(status); });
+        if (statuses.size() > 256) return false;
+        
+        uint64_t tasks = 0, heapSize = snapshot.archiveDir().size();
+        snapshot.forEach([&](const TaskRow& row) {
+            tasks++;
+            heapSize += row.desc.size() + row.createdAt.size() + row.updatedAt.size() + row.extra.size();
+        });
+        for (string_view status : statuses) heapSize += status.size();
+        for (const string& segment : snapshot.segments()) heapSize += segment.size();
+        uint64_t strings = TASK_STRINGS * tasks + statuses.size() + 1 + snapshot.segments().size();
+        size_t size = sizeof(DataHeader) + 8 * statuses.size() + 8 * (strings + 1) + 5 * tasks + heapSize;
+        
+        string object = dataName(generation + 1);
+        shm_unlink(object.c_str());
+        int fd = shm_open(object.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) return false;
+        void* p = size > 0 && ftruncate(fd, (off_t)size) == 0
+                ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(object.c_str());
+            return false;
+        }
+        
+        char* out = (char*)p;
+        DataHeader* head = (DataHeader*)out;
+        memcpy(head->magic, "TTSHMD2", 8);
+        head->version = snapshot.version;
+        head->tasks = tasks;
+        head->statuses = statuses.size();
+        head->segments = snapshot.segments().size();
+        head->size = size;
+        uint64_t* countOut = (uint64_t*)(out + sizeof(DataHeader));
+        uint64_t* offsetOut = countOut + statuses.size();
+        int32_t* idOut = (int32_t*)(offsetOut + strings + 1);
+        uint8_t* statusOut = (uint8_t*)(idOut + tasks);
+        char* heapOut = (char*)(statusOut + tasks);
+        
+        uint64_t used = 0, k = 0;
+        auto put = [&](string_view str) {
+            offsetOut[k++] = used;
+            memcpy(heapOut + used, str.data(), str.size());
+            used += str.size();
+        };
+        size_t i = 0;
+        snapshot.forEachCount([&](string_view, size_t count) { countOut[i++] = count; });
+        i = 0;
+        snapshot.forEach([&](const TaskRow& row) {
+            idOut[i] = row.id;
+            statusOut[i++] = (uint8_t)(lower_bound(statuses.begin(), statuses.end(), row.status) - statuses.begin());
+            put(row.desc);
+            put(row.createdAt);
+            put(row.updatedAt);
+            put(row.extra);
+        });
+        for (string_view status : statuses) put(status);
+        put(snapshot.archiveDir());
+        for (const string& segment : snapshot.segments()) put(segment);
+        offsetOut[k] = used;
+        munmap(p, size);
+        
+        lock_guard<mutex> guard(writing);
+        generation++;
+        update([&]() {
+            header->published.store(snapshot.version, memory_order_relaxed);
+            header->generation.store(generation, memory_order_relaxed);
+        });
+        if (generation > 1) shm_unlink(dataName(generation - 1).c_str());
+        return true;
+    }
+    
+    // Server: remove everything published
+    void destroy() {
+        if (generation > 0) shm_unlink(dataName(generation).c_str());
+        shm_unlink(name.c_str());
+    }
+    
+    // Client: map the published tasks; false unless a live server has
+    // published everything it committed
+    bool open() {
+        headerFd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (headerFd < 0) return false;
+        struct stat st;
+        if (fstat(headerFd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) return false;
+        void* p = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, headerFd, 0);
+        if (p == MAP_FAILED) return false;
+        header = (Header*)p;
+        
+        // A new object can replace the one read here, so retry a few times
+        for (int attempt = 0; attempt < 4; attempt++) {
+            uint64_t seq, pid, version, published, gen;
+            do {
+                seq = header->seq.load(memory_order_acquire);
+                pid = header->pid.load(memory_order_relaxed);
+                version = header->version.load(memory_order_relaxed);
+                published = header->published.load(memory_order_relaxed);
+                gen = header->generation.load(memory_order_relaxed);
+                atomic_thread_fence(memory_order_acquire);
+            } while ((seq & 1) != 0 || header->seq.load(memory_order_relaxed) != seq);
+            if (memcmp(header->magic, "TTSHMI1", 8) != 0 || pid == 0 || kill((pid_t)pid, 0) != 0) return false;
+            if (version != published || gen == 0) return false;
+            
+            int fd = shm_open(dataName(gen).c_str(), O_RDONLY, 0);
+            if (fd < 0) continue;
+            if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(DataHeader)) {
+                p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            }
+            else {
+                p = MAP_FAILED;
+            }
+            ::close(fd);
+            if (p == MAP_FAILED) continue;
+            
+            data = (char*)p;
+            length = (size_t)st.st_size;
+            info = (const DataHeader*)data;
+            if (memcmp(info->magic, "TTSHMD2", 8) != 0 || info->version != published || info->size != length) {
+                munmap(data, length);
+                data = nullptr;
+                continue;
+            }
+            counts = (const uint64_t*)(data + sizeof(DataHeader));
+            offsets = counts + info->statuses;
+            uint64_t strings = TASK_STRINGS * info->tasks + info->statuses + 1 + info->segments;
+            ids = (const int32_t*)(offsets + strings + 1);
+            statusOf = (const uint8_t*)(ids + info->tasks);
+            heap = (const char*)(statusOf + info->tasks);
+            return true;
+        }
+        return false;
+    }
+    
+    // The read-only view for answerReadOnly
+    template <typename F>
+    void forEach(F visit) const {
+        uint64_t statusBase = TASK_STRINGS * info->tasks;
+        for (uint64_t i = 0; i < info->tasks; i++) {
+            uint64_t k = TASK_STRINGS * i;
+            visit(TaskRow{ids[i], text(k), text(statusBase + statusOf[i]),
+                          text(k + 1), text(k + 2), text(k + 3)});
+        }
+    }
+    
+    template <typename F>
+    void forEachCount(F visit) const {
+        for (uint64_t s = 0; s < info->statuses; s++) visit(text(TASK_STRINGS * info->tasks + s), counts[s]);
+    }
+    
+    string archiveDir() const {
+        return string(text(TASK_STRINGS * info->tasks + info->statuses));
+    }
+    
+    vector<string> segments() const {
+        vector<string> names;
+        uint64_t first = TASK_STRINGS * info->tasks + info->statuses + 1;
+        for (uint64_t j = 0; j < info->segments; j++) names.push_back(string(text(first + j)));
+        return names;
+    }
+};
+
+// Long-lived server for "task-cli serve". Other task-cli invocations send
+// their command line over SERVER_SOCKET and one resident TaskManager runs
+// it, so the tasks stay loaded between commands. Commands run one at a time
+// on a single thread, in batches with group commit: a batch is whatever
+// arrived while the previous one was being saved, plus anything arriving
+// within the window after its first request, up to batchSize requests. The
+// whole batch is saved with one commit and one fsync, and only then is each
+// client sent its output, so write throughput grows with the number of
+// clients instead of being capped by the fsync rate.
+//
+// Plain listings, counts and searches skip the queue: the connection thread
+// answers them from the latest published TaskSnapshot, which the applier
+// replaces after each saved batch, so reads never wait behind writes and
+// always see whole batches. A publisher thread then copies each snapshot
+// into a SharedIndex, from which clients answer those commands themselves
+// once it has caught up.
+class TaskServer {
+private:
+    struct Request {
+        int fd;
+        vector<string> args;
+    };
+    
+    TaskManager manager;
+    int windowUs;
+    size_t batchSize;
+    mutex lock;
+    condition_variable ready;
+    deque<Request> queue;
+    bool stopping = false;
+    size_t connections = 0; // Still being received or answered
+    condition_variable idle;
+    
+    SnapshotStore snapshots;
+    vector<pair<int, unique_ptr<TaskTracker>>> changes; // Applier only
+    SharedIndex shared{"tasks.json"};
+    bool sharing = false;
+    uint64_t committed = 1; // Latest snapshot version, under lock
+    condition_variable publishWanted;
+    
+    static int listenFd;
+    
+    static void stop(int) {
+        shutdown(listenFd, SHUT_RDWR);
+    }
+    
+    static bool readAll(int fd, void* data, size_t size) {
+        char* p = (char*)data;
+        while (size > 0) {
+            ssize_t got = read(fd, p, size);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            p += got;
+            size -= got;
+        }
+        return true;
+    }
+    
+    static bool writeAll(int fd, const void* data, size_t size) {
+        const char* p = (const char*)data;
+        while (size > 0) {
+            ssize_t put = write(fd, p, size);
+            if (put < 0 && errno == EINTR) continue;
+            if (put <= 0) return false;
+            p += put;
+            size -= put;
+        }
+        return true;
+    }
+    
+    // Read one request: an argument count, then each argument with its
+    // length. Runs on its own thread so a slow client holds up nobody.
+    void receive(int fd) {
+        Request request{fd, {}};
+        uint32_t argc = 0;
+        bool ok = readAll(fd, &argc, 4) && argc < 1024;
+        for (uint32_t i = 0; ok && i < argc; i++) {
+            uint32_t length = 0;
+            ok = readAll(fd, &length, 4) && length < (1u << 24);
+            string arg(ok ? length : 0, '\0');
+            ok = ok && readAll(fd, &arg[0], length);
+            request.args.push_back(move(arg));
+        }
+        if (!ok) {
+            ::close(fd);
+            return;
+        }
+        
+        ostringstream out;
+        int result = answerFromSnapshot(request.args, out);
+        if (result >= 0) {
+            reply(fd, result, out.str());
+            return;
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            queue.push_back(move(request));
+        }
+        ready.notify_one();
+    }
+    
+    // Send the exit code and output, then hang up
+    static void reply(int fd, int32_t result, const string& output) {
+        uint32_t length = (uint32_t)output.size();
+        if (writeAll(fd, &result, 4) && writeAll(fd, &length, 4)) {
+            writeAll(fd, output.data(), length);
+        }
+        ::close(fd);
+    }
+    
+    // Run a read-only command on the current snapshot; -1 if the command
+    // is not one that can
+    int answerFromSnapshot(const vector<string>& args, ostream& out) {
+        SnapshotStore::Reader snapshot(snapshots);
+        return answerReadOnly(*snapshot, args, out);
+    }
+    
+    // Publish the tasks changed by the last batch as the next snapshot
+    void publishChanges() {
+        if (changes.empty()) return;
+        TaskSnapshot* next = snapshots.latest()->edit();
+        for (const auto& change : changes) next->apply(change.first, change.second.get());
+        next->setArchive(manager.archived());
+        changes.clear();
+        snapshots.publish(next);
+        if (sharing) {
+            shared.announce(next->version);
+            lock_guard<mutex> guard(lock);
+            committed = next->version;
+            publishWanted.notify_one();
+        }
+    }
+    
+    // Copy the latest snapshot into shared memory whenever it has moved on,
+    // skipping versions committed while the last copy was written
+    void publishLoop() {
+        uint64_t published = 1; // By run
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                publishWanted.wait(guard, [&]() { return stopping || committed != published; });
+                if (stopping) return;
+            }
+            SnapshotStore::Reader snapshot(snapshots);
+            shared.publish(*snapshot);
+            published = snapshot->version;
+        }
+    }
+    
+    // Wait for a request, then up to the window for more; empty when stopping
+    // The next batch of requests, empty if none came within a second (so
+    // leases are still checked); false once stopping and drained
+    bool nextBatch(vector<Request>& batch) {
+        batch.clear();
+        unique_lock<mutex> guard(lock);
+        ready.wait_for(guard, chrono::seconds(1), [&]() { return !queue.empty() || stopping; });
+        if (queue.empty()) return !stopping;
+        auto deadline = chrono::steady_clock::now() + chrono::microseconds(windowUs);
+        while (queue.size() < batchSize && !stopping &&
+               ready.wait_until(guard, deadline) != cv_status::timeout) {}
+        
+        while (!queue.empty() && batch.size() < batchSize) {
+            batch.push_back(move(queue.front()));
+            queue.pop_front();
+        }
+        return true;
+    }
+    
+    // Run one command line against the resident manager, capturing its output
+    int execute(const vector<string>& args, string& output) {
+        vector<char*> argv;
+        for (const string& arg : args) argv.push_back((char*)arg.c_str());
+        ostringstream out;
+        streambuf* saved = cout.rdbuf(out.rdbuf());
+        int result;
+        try {
+            result = runCommand((int)argv.size(), argv.data(), &manager);
+        }
+        catch (const exception& e) {
+            out << "Error: " << e.what() << endl;
+            result = 1;
+        }
+        cout.rdbuf(saved);
+        output = out.str();
+        return result;
+    }
+    
+    void applyLoop() {
+        vector<Request> batch;
+        while (nextBatch(batch)) {
+            vector<pair<int32_t, string>> replies(batch.size());
+            for (size_t i = 0; i < batch.size(); i++) {
+                replies[i].first = execute(batch[i].args, replies[i].second);
+            }
+            manager.expireLeases();
+            
+            // Acknowledge and show the batch only once it is all on disk
+            manager.flushCommits();
+            publishChanges();
+            for (size_t i = 0; i < batch.size(); i++) {
+                reply(batch[i].fd, replies[i].first, replies[i].second);
+            }
+        }
+    }
+    
+public:
+    TaskServer(int window, size_t batch) : windowUs(window), batchSize(batch) {
+        // Before any snapshot shows the archive next to the hot tasks
+        manager.finishArchive();
+        manager.setGroupCommit(true);
+        manager.setResident(true);
+        manager.setChangeListener([this](int id, const TaskTracker* task) {
+            changes.emplace_back(id, task != nullptr ? new TaskTracker(*task) : nullptr);
+        });
+    }
+    
+    // Serve until SIGINT or SIGTERM
+    int run(const string& path) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(listenFd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+            cout << "Error: A server is already running on " << path << endl;
+            return 1;
+        }
+        ::close(listenFd);
+        unlink(path.c_str()); // Left behind by a server that did not exit cleanly
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 128) != 0) {
+            cout << "Error: Cannot listen on " << path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        vector<TaskTracker> tasks;
+        manager.scanTasks([&](const TaskTracker& task) { tasks.push_back(task); });
+        snapshots.publish(new TaskSnapshot(move(tasks), manager.archived()));
+        sharing = shared.create();
+        if (sharing) {
+            shared.announce(snapshots.latest()->version);
+            shared.publish(*snapshots.latest());
+        }
+        
+        signal(SIGINT, stop);
+        signal(SIGTERM, stop);
+        signal(SIGPIPE, SIG_IGN);
+        cout << "Serving tasks on " << path << endl;
+        
+        thread applier(&TaskServer::applyLoop, this);
+        thread publisher;
+        if (sharing) publisher = thread(&TaskServer::publishLoop, this);
+        while (true) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0 && errno == EINTR) continue;
+            if (fd < 0) break;
+            {
+                lock_guard<mutex> guard(lock);
+                connections++;
+            }
+            thread([this, fd]() {
+                receive(fd);
+                lock_guard<mutex> guard(lock);
+                if (--connections == 0) idle.notify_all();
+            }).detach();
+        }
+        
+        {
+            // Requests still arriving go into the last batch
+            unique_lock<mutex> guard(lock);
+            idle.wait(guard, [&]() { return connections == 0; });
+            stopping = true;
+        }
+        ready.notify_all();
+        publishWanted.notify_all();
+        applier.join();
+        if (publisher.joinable()) publisher.join();
+        shared.destroy();
+        manager.flushCommits();
+        ::close(listenFd);
+        unlink(path.c_str());
+        return 0;
+    }
+};
+
+int TaskServer::listenFd = -1;
+
+// False when TASK_DAEMON=0 asks to run everything locally
+bool serverAllowed() {
+    const char* env = getenv("TASK_DAEMON");
+    return env == nullptr || strcmp(env, "0") != 0;
+}
+
+// Answer plain list, count and search from the tasks a running server has
+// published in shared memory; false if it has not caught up or the command
+// is another one
+bool answerFromSharedIndex(int argc, char* argv[], int& result) {
+    if (argc < 2 || !serverAllowed()) return false;
+    string command = argv[1];
+    if (command != "list" && command != "count" && command != "search" && command != "query") return false;
+    SharedIndex index("tasks.json");
+    if (!index.open()) return false;
+    result = answerReadOnly(index, vector<string>(argv, argv + argc), cout);
+    return result >= 0;
+}
+
+// Run the command on a server if one is listening (TASK_DAEMON=0 never
+// forwards). Returns false when there is none, so the command runs here.
+bool forwardToServer(int argc, char* argv[], int& result) {
+    struct stat st;
+    if (!serverAllowed() || stat(SERVER_SOCKET, &st) != 0) return false;
+    
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, SERVER_SOCKET, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    
+    string request;
+    uint32_t count = (uint32_t)argc;
+    request.append((const char*)&count, 4);
+    for (int i = 0; i < argc; i++) {
+        uint32_t length = (uint32_t)strlen(argv[i]);
+        request.append((const char*)&length, 4);
+        request.append(argv[i], length);
+    }
+    
+    int32_t code = 1;
+    uint32_t length = 0;
+    string output;
+    bool ok = write(fd, request.data(), request.size()) == (ssize_t)request.size();
+    auto readAll = [&](void* data, size_t size) {
+        char* p = (char*)data;
+        while (ok && size > 0) {
+            ssize_t got = read(fd, p, size);
+            ok = got > 0;
+            p += max<ssize_t>(got, 0);
+            size -= max<ssize_t>(got, 0);
+        }
+    };
+    readAll(&code, 4);
+    readAll(&length, 4);
+    output.resize(ok ? length : 0);
+    readAll(&output[0], output.size());
+    close(fd);
+    if (!ok) {
+        cerr << "Error: Lost connection to the task server" << endl;
+        result = 1;
+        return true;
+    }
+    cout << output;
+    result = code;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // --timings and --stats may appear anywhere; strip them before the
+    // command is parsed
+    auto envFlag = [](const char* name) {
+        const char* env = getenv(name);
+        return env != nullptr && *env != '\0' && strcmp(env, "0") != 0;
+    };
+    bool wantTimings = envFlag("TASK_TIMINGS");
+    bool wantStats = envFlag("TASK_STATS");
+    vector<char*> args;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && strcmp(argv[i], "--timings") == 0) {
+            wantTimings = true;
+        }
+        else if (i > 0 && strcmp(argv[i], "--stats") == 0) {
+            wantStats = true;
+        }
+        else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (wantTimings || wantStats) timings.enable(wantStats);
+    
+    int result;
+    bool forwarded = args.size() >= 2 && strcmp(args[1], "serve") != 0 &&
+                     (answerFromSharedIndex((int)args.size(), args.data(), result) ||
+                      forwardToServer((int)args.size(), args.data(), result));
+    if (!forwarded) result = runCommand((int)args.size(), args.data());
+    
+    if (timings.isEnabled()) {
+        {
+            ScopedPhase phase(PHASE_OUTPUT);
+            cout.flush();
+        }
+        timings.report(cerr);
+    }
+    return result;
+}
+
+// Tags are stored comma-separated in one field, and kept free of quotes,
+// backslashes and control characters so they read the same everywhere
+bool validTag(const string& tag) {
+    return !tag.empty() && none_of(tag.begin(), tag.end(), [](char c) {
+        return c == ',' || c == '"' || c == '\\' || (unsigned char)c < 0x20 || c == 0x7f;
+    });
+}
+
+// Split "--tag a --tag b --status s" into tags and status; false if
+// anything else is there or no tag is given
+bool parseTagFilter(const vector<string>& args, vector<string>& tags, string& status) {
+    for (size_t i = 0; i < args.size(); i += 2) {
+        if (i + 1 >= args.size()) return false;
+        if (args[i] == "--tag" && validTag(args[i + 1])) tags.push_back(args[i + 1]);
+        else if (args[i] == "--status") status = args[i + 1];
+        else return false;
+    }
+    return !tags.empty();
+}
+
+// The live and archived tasks of a manager as a view for answerQuery
+class ManagerRows {
+private:
+    TaskManager& manager;
+    
+public:
+    explicit ManagerRows(TaskManager& m) : manager(m) {}
+    
+    template <typename F>
+    void forEach(F visit) const {
+        manager.scanTasks([&](const TaskTracker& task) {
+            visit({task.getId(), task.desc, task.status, task.createdAt, task.updatedAt, task.extra});
+        });
+    }
+    
+    string archiveDir() const {
+        return manager.archived().dir;
+    }
+    
+    vector<string> segments() const {
+        vector<string> names;
+        for (const auto& segment : manager.archived().segments) names.push_back(segment.name);
+        return names;
+    }
+};
+
+// Run one command line, against resident when called by TaskServer
+int runCommand(int argc, char* argv[], TaskManager* resident) {
+    // The tasks are opened only once the arguments have been checked, so
+    // usage and argument errors never touch the storage. Without a server,
+    // commands that change them hold tasks.lock from before loading until
+    // they exit, so concurrent ones (claims above all) never work on the
+    // same stale copy.
+    unique_ptr<FileLock> locked;
+    unique_ptr<TaskManager> opened;
+    auto manager = [&]() -> TaskManager& {
+        if (resident != nullptr) return *resident;
+        if (!opened) {
+            string name = argv[1];
+            if (name != "list" && name != "count" && name != "search" && name != "export" && name != "next" &&
+                name != "query") {
+                locked.reset(new FileLock(baseName("tasks.json") + ".lock"));
+            }
+            opened.reset(new TaskManager());
+            if (locked) opened->finishArchive();
+        }
+        return *opened;
+    };
+    
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    
+    string command = argv[1];
+    
+    if (command == "add") {
+        if (argc < 3) {
+            cout << "Error: Please provide a task description" << endl;
+            return 1;
+        }
+        int priority = 0, parent = 0;
+        vector<string> tags;
+        for (int i = 3; i < argc; i += 2) {
+            if (i + 1 < argc && strcmp(argv[i], "--priority") == 0) {
+                priority = atoi(argv[i + 1]);
+            }
+            else if (i + 1 < argc && strcmp(argv[i], "--parent") == 0 && atoi(argv[i + 1]) > 0) {
+                parent = atoi(argv[i + 1]);
+            }
+            else if (i + 1 < argc && strcmp(argv[i], "--tag") == 0 && validTag(argv[i + 1])) {
+                tags.push_back(argv[i + 1]);
+            }
+            else {
+                cout << "Error: Please use add <description> [--priority n] [--tag tag]... [--parent id]" << endl;
+                return 1;
+            }
+        }
+        manager().addTask(argv[2], priority, tags, parent);
+    }
+    else if (command == "update") {
+        if (argc < 4) {
+            cout << "Error: Please provide task ID and new description" << endl;
+            return 1;
+        }
+        int id = stoi(argv[2]);
+        manager().updateTask(id, argv[3]);
+    }
+    else if (command == "delete") {
+        if (argc < 3) {
+            cout << "Error: Please provide task ID" << endl;
+            return 1;
+        }
+        int id = stoi(argv[2]);
+        manager().deleteTask(id);
+    }
+    else if (command == "mark-in-progress") {
+        if (argc < 3) {
+            cout << "Error: Please provide task ID" << endl;
+            return 1;
+        }
+        int id = stoi(argv[2]);
+        manager().markInProgress(id);
+    }
+    else if (command == "mark-done") {
+        if (argc < 3) {
+            cout << "Error: Please provide task ID" << endl;
+            return 1;
+        }
+        int id = stoi(argv[2]);
+        manager().markDone(id);
+    }
+    else if (command == "claim") {
+        string worker;
+        int lease = -1;
+        for (int i = 2; i < argc; i += 2) {
+            if (i + 1 < argc && strcmp(argv[i], "--worker") == 0) {
+                worker = argv[i + 1];
+            }
+            else if (i + 1 < argc && strcmp(argv[i], "--lease") == 0 && isdigit((unsigned char)argv[i + 1][0])) {
+                lease = atoi(argv[i + 1]);
+            }
+            else {
+                cout << "Error: Please use claim [--worker name] [--lease seconds]" << endl;
+                return 1;
+            }
+        }
+        return manager().claimTask(worker, lease) ? 0 : 1;
+    }
+    else if (command == "priority") {
+        if (argc < 4) {
+            cout << "Error: Please provide task ID and priority" << endl;
+            return 1;
+        }
+        int id = stoi(argv[2]);
+        manager().setPriority(id, atoi(argv[3]));
+    }
+    else if (command == "depend") {
+        if (argc != 5 || strcmp(argv[3], "on") != 0) {
+            cout << "Error: Please use depend <id> on <id>" << endl;
+            return 1;
+        }
+        int id = stoi(argv[2]);
+        int dependency = stoi(argv[4]);
+        if (id == dependency) {
+            cout << "Error: A task cannot depend on itself" << endl;
+            return 1;
+        }
+        manager().addDependency(id, dependency);
+    }
+    else if (command == "tag" || command == "untag") {
+        vector<string> tags(argv + min(argc, 3), argv + argc);
+        if (argc < 4 || !all_of(tags.begin(), tags.end(), validTag)) {
+            cout << "Error: Please provide task ID and one or more tags (without commas, quotes or backslashes)" << endl;
+            return 1;
+        }
+        int id = stoi(argv[2]);
+        manager().tagTask(id, tags, command == "tag");
+    }
+    else if (command == "next") {
+        string status = "todo";
+        if (argc == 4 && strcmp(argv[2], "--status") == 0) {
+            status = argv[3];
+        }
+        else if (argc != 2) {
+            cout << "Error: Please use next [--status status]" << endl;
+            return 1;
+        }
+        return manager().nextTask(status) ? 0 : 1;
+    }
+    else if (command == "heartbeat") {
+        string worker;
+        int seconds = -1;
+        bool valid = argc >= 3 && isdigit((unsigned char)argv[2][0]);
+        for (int i = 3; valid && i < argc; i++) {
+            if (i + 1 < argc && strcmp(argv[i], "--worker") == 0) {
+                worker = argv[++i];
+            }
+            else if (seconds == -1 && isdigit((unsigned char)argv[i][0]) && atoi(argv[i]) > 0) {
+                seconds = atoi(argv[i]);
+            }
+            else {
+                valid = false;
+            }
+        }
+        if (!valid) {
+            cout << "Error: Please use heartbeat <id> [seconds] [--worker name] with seconds above 0" << endl;
+            return 1;
+        }
+        return manager().heartbeat(stoi(argv[2]), worker, seconds) ? 0 : 1;
+    }
+    else if (command == "list") {
+        // --all adds archived tasks to plain and status listings
+        vector<string> args(argv + 2, argv + argc);
+        auto all = find(args.begin(), args.end(), "--all");
+        bool includeArchive = all != args.end();
+        if (includeArchive) args.erase(all);
+        
+        if (args.size() == 1 && args[0] == "--ready" && !includeArchive) {
+            manager().listReadyTasks();
+        }
+        else if (!args.empty() && args[0] == "--tree") {
+            if (args.size() > 2 || includeArchive || (args.size() == 2 && atoi(args[1].c_str()) <= 0)) {
+                cout << "Error: Please use list --tree [id]" << endl;
+                return 1;
+            }
+            manager().listTaskTree(args.size() == 2 ? atoi(args[1].c_str()) : 0);
+        }
+        else if (find(args.begin(), args.end(), "--tag") != args.end()) {
+            vector<string> tags;
+            string status;
+            if (!parseTagFilter(args, tags, status) || includeArchive) {
+                cout << "Error: Please use list --tag tag [--tag tag]... [--status status]" << endl;
+                return 1;
+            }
+            manager().listTasksByTags(tags, status, false);
+        }
+        else if (args.empty()) {
+            manager().listAllTasks(includeArchive);
+        }
+        else if (args[0].rfind("--", 0) == 0) {
+            string option = args[0];
+            bool byUpdated = option.rfind("--updated-", 0) == 0;
+            bool since = option == "--updated-since" || option == "--created-since";
+            bool between = option == "--updated-between" || option == "--created-between";
+            if ((!since && !between) || args.size() != (since ? 2u : 3u)) {
+                cout << "Error: Invalid list option" << endl;
+                printUsage();
+                return 1;
+            }
+            
+            time_t now = time(0);
+            time_t from, to = numeric_limits<time_t>::max();
+            if (!parseTimeArg(args[1], now, from) ||
+                (between && !parseTimeArg(args[2], now, to))) {
+                cout << "Error: Invalid time" << endl;
+                return 1;
+            }
+            manager().listTasksByTime(byUpdated, from, to);
+        }
+        else if (args.size() == 1) {
+            manager().listTasksByStatus(args[0], includeArchive);
+        }
+    }
+    else if (command == "serve") {
+        int windowUs = argc >= 3 ? atoi(argv[2]) : 200;
+        int batch = argc >= 4 ? atoi(argv[3]) : 128;
+        if (resident != nullptr) {
+            cout << "Error: Already running as a server" << endl;
+            return 1;
+        }
+        if (windowUs < 0 || batch <= 0) {
+            cout << "Error: Please provide the window in microseconds and a batch size" << endl;
+            return 1;
+        }
+        return TaskServer(windowUs, batch).run(SERVER_SOCKET);
+    }
+    else if (command == "count") {
+        vector<string> args(argv + 2, argv + argc);
+        vector<string> tags;
+        string status;
+        if (find(args.begin(), args.end(), "--tag") == args.end()) {
+            manager().countTasks(argc >= 3 ? argv[2] : "");
+        }
+        else if (parseTagFilter(args, tags, status)) {
+            manager().listTasksByTags(tags, status, true);
+        }
+        else {
+            cout << "Error: Please use count --tag tag [--tag tag]... [--status status]" << endl;
+            return 1;
+        }
+    }
+    else if (command == "search") {
+        if (argc < 3) {
+            cout << "Error: Please provide text to search for" << endl;
+            return 1;
+        }
+        manager().searchTasks(argv[2]);
+    }
+    else if (command == "query") {
+        ScopedPhase phase(PHASE_LOOKUP);
+        return answerQuery(ManagerRows(manager()), vector<string>(argv, argv + argc), cout);
+    }
+    else if (command == "archive") {
+        int days = argc >= 3 ? atoi(argv[2]) : 30;
+        if (argc >= 3 && (days < 0 || !isdigit((unsigned char)argv[2][0]))) {
+            cout << "Error: Please provide the age in days" << endl;
+            return 1;
+        }
+        manager().archiveTasks(days);
+    }
+    else if (command == "export") {
+        manager().exportTasks(cout, argc >= 3 ? argv[2] : "");
+    }
+    else if (command == "storage") {
+        if (argc < 3) {
+            cout << "Tasks are stored as " << manager().storageName() << endl;
+            return 0;
+        }
+        string kind = argv[2];
+        if (find(begin(STORAGE_KINDS), end(STORAGE_KINDS), kind) == end(STORAGE_KINDS)) {
+            cout << "Error: Please choose a storage: json, ndjson, sharded, records or btree" << endl;
+            return 1;
+        }
+        int size = argc >= 4 ? atoi(argv[3]) : 10000;
+        if (size <= 0) {
+            cout << "Error: Shard size must be a positive number" << endl;
+            return 1;
+        }
+        manager().migrateStorage(kind, size);
+    }
+    else if (command == "format") {
+        string format = argc >= 3 ? argv[2] : "";
+        if (format != "ndjson" && format != "json" && format != "records") {
+            cout << "Error: Please choose a format: json, ndjson or records" << endl;
+            return 1;
+        }
+        manager().migrateStorage(format);
+    }
+    else if (command == "shard") {
+        int size = argc >= 3 ? atoi(argv[2]) : 10000;
+        if (size <= 0) {
+            cout << "Error: Shard size must be a positive number" << endl;
+            return 1;
+        }
+        manager().migrateStorage("sharded", size);
+    }
+    else if (command == "unshard") {
+        manager().migrateStorage("json");
+    }
+    else {
+        cout << "Error: Unknown command '" << command << "'" << endl;
+        printUsage();
+        return 1;
+    }
+    
+    return 0;
+}
+#endif